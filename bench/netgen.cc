@@ -0,0 +1,161 @@
+#include <sstream>
+#include <vector>
+#include <algorithm>
+
+#include "netgen.h"
+
+
+static const char* const designnames[numdesigns] = {
+    "adder", "shift", "lfsr", "counter", "nand"
+};
+
+
+/** Returns the name of a kind of design.
+ *
+ * @author Diesel
+ */
+const char* designname(benchdesign kind) {
+    return designnames[kind];
+}
+
+
+/** Looks up a kind of design by name.
+ *
+ * @author Diesel
+ */
+bool finddesign(const std::string& str, benchdesign& kind) {
+    for (int k = 0; k < numdesigns; k++) {
+        if (str == designnames[k]) {
+            kind = (benchdesign) k;
+            return true;
+        }
+    }
+    return false;
+}
+
+
+/** Writes monitors for up to nmonitors of the outputs given, evenly spaced
+ *  so both ends of long chains are included.
+ */
+static void writemonitors(std::ostream& os, const std::vector<std::string>& outputs, int nmonitors) {
+    int n = std::min<int>(nmonitors, outputs.size());
+    for (int m = 0; m < n; m++) {
+        int k = (n == 1) ? 0 : (long long) m * (outputs.size() - 1) / (n - 1);
+        os << "monitor " << outputs[k] << ";\n";
+    }
+}
+
+
+/** Writes ripple-carry adders of 7 devices a bit, with two gates a bit on
+ *  the carry path. A is all ones and B all zeros, so the carry in ripples
+ *  through every bit of each adder.
+ */
+static void genadder(std::ostream& os, int ndevices, int depth, std::vector<std::string>& outputs) {
+    int bits = std::max(1, (ndevices - 1) / 7);
+    depth = std::max(1, depth / 2);
+    os << "dev CIN = CLOCK { Period : 1; }\n";
+    for (int b = 0; b < bits; b++) {
+        std::string cin = (b % depth == 0) ? "CIN" : "C" + std::to_string(b);
+        std::string i = std::to_string(b);
+        os << "dev A" << i << " = SWITCH { InitialValue : 1; }\n"
+           << "dev B" << i << " = SWITCH { InitialValue : 0; }\n"
+           << "dev P" << i << " = XOR { I1 : A" << i << "; I2 : B" << i << "; }\n"
+           << "dev S" << i << " = XOR { I1 : P" << i << "; I2 : " << cin << "; }\n"
+           << "dev G" << i << " = AND { I1 : A" << i << "; I2 : B" << i << "; }\n"
+           << "dev T" << i << " = AND { I1 : P" << i << "; I2 : " << cin << "; }\n"
+           << "dev C" << b + 1 << " = OR { I1 : G" << i << "; I2 : T" << i << "; }\n";
+        outputs.push_back("S" + i);
+        if ((b + 1) % depth == 0 || b + 1 == bits)
+            outputs.push_back("C" + std::to_string(b + 1));
+    }
+}
+
+
+/** Writes a Johnson counter, a shift register fed back from its last QBAR.
+ */
+static void genshift(std::ostream& os, int ndevices, std::vector<std::string>& outputs) {
+    int stages = std::max(1, ndevices - 1);
+    os << "dev CK = CLOCK { Period : 1; }\n"
+       << "dev D0 = DTYPE;\n";
+    for (int d = 1; d < stages; d++)
+        os << "dev D" << d << " = DTYPE { DATA : D" << d - 1 << ".Q; CLK : CK; SET : 0; CLEAR : 0; }\n";
+    os << "dev D0 { DATA : D" << stages - 1 << ".QBAR; CLK : CK; SET : 0; CLEAR : 0; }\n";
+    for (int d = 0; d < stages; d++)
+        outputs.push_back("D" + std::to_string(d) + ".Q");
+}
+
+
+/** Writes a linear feedback shift register, fed back with the XNOR of its
+ *  last stage and one halfway along, so it starts from all zeros.
+ */
+static void genlfsr(std::ostream& os, int ndevices, std::vector<std::string>& outputs) {
+    int stages = std::max(2, ndevices - 3);
+    os << "dev CK = CLOCK { Period : 1; }\n"
+       << "dev F = NAND;\n"
+       << "dev D0 = DTYPE { DATA : F; CLK : CK; SET : 0; CLEAR : 0; }\n";
+    for (int d = 1; d < stages; d++)
+        os << "dev D" << d << " = DTYPE { DATA : D" << d - 1 << ".Q; CLK : CK; SET : 0; CLEAR : 0; }\n";
+    os << "dev X = XOR { I1 : D" << stages - 1 << ".Q; I2 : D" << stages / 2 - 1 << ".Q; }\n"
+       << "dev F { I1 : X; }\n";
+    for (int d = 0; d < stages; d++)
+        outputs.push_back("D" + std::to_string(d) + ".Q");
+}
+
+
+/** Writes 16 bit ripple counters of toggling DTYPEs, each counting the
+ *  pulses of its own SIGGEN.
+ */
+static void gencounter(std::ostream& os, int ndevices, std::vector<std::string>& outputs) {
+    const int bits = 16;
+    int counters = std::max(1, ndevices / (bits + 1));
+    for (int c = 0; c < counters; c++) {
+        std::string g = "G" + std::to_string(c);
+        os << "dev " << g << " = SIGGEN { Period : " << 1 + c % 4 << "; Sig : $01; }\n";
+        for (int b = 0; b < bits; b++) {
+            std::string q = "Q" + std::to_string(c) + "B" + std::to_string(b);
+            std::string clk = (b == 0) ? g : "Q" + std::to_string(c) + "B" + std::to_string(b - 1) + ".QBAR";
+            os << "dev " << q << " = DTYPE { DATA : " << q << ".QBAR; CLK : " << clk
+               << "; SET : 0; CLEAR : 0; }\n";
+            outputs.push_back(q + ".Q");
+        }
+    }
+}
+
+
+/** Writes chains of NANDs, each inverting the last.
+ */
+static void gennand(std::ostream& os, int ndevices, int depth, std::vector<std::string>& outputs) {
+    int length = std::max(1, ndevices - 1);
+    os << "dev CK = CLOCK { Period : 1; }\n";
+    for (int n = 0; n < length; n++) {
+        os << "dev N" << n << " = NAND { I1 : ";
+        if (n % depth == 0)
+            os << "CK";
+        else
+            os << "N" << n - 1;
+        os << "; I2 : 1; }\n";
+        outputs.push_back("N" + std::to_string(n));
+    }
+}
+
+
+/** Writes the definition file of a synthetic design.
+ *
+ * @author Diesel
+ */
+std::string gennetwork(benchdesign kind, int ndevices, int depth, int nmonitors) {
+    std::ostringstream os;
+    std::vector<std::string> outputs;
+    depth = std::max(1, depth);
+    os << "// " << designname(kind) << " benchmark, " << ndevices << " devices, depth " << depth << "\n";
+    switch (kind) {
+        case adderdesign:   genadder(os, ndevices, depth, outputs); break;
+        case shiftdesign:   genshift(os, ndevices, outputs);        break;
+        case lfsrdesign:    genlfsr(os, ndevices, outputs);         break;
+        case counterdesign: gencounter(os, ndevices, outputs);      break;
+        case nanddesign:    gennand(os, ndevices, depth, outputs);  break;
+        default:                                                    break;
+    }
+    writemonitors(os, outputs, nmonitors);
+    return os.str();
+}
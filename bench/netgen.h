@@ -0,0 +1,52 @@
+#ifndef GF2_NETGEN_H
+#define GF2_NETGEN_H
+
+#include <string>
+
+
+/** Kinds of synthetic design made by gennetwork.
+ *
+ *  adderdesign    ripple-carry adders of depth/2 bits, whose carry in is a
+ *                 clock, so every sum and carry changes on each cycle
+ *  shiftdesign    shift register of DTYPEs wired as a Johnson counter
+ *  lfsrdesign     shift register of DTYPEs with XNOR feedback
+ *  counterdesign  16 bit ripple counters of DTYPEs, each driven by a SIGGEN
+ *  nanddesign     chains of depth NANDs used as inverters, driven by a clock
+ *
+ *  The combinational designs are split into blocks with a given number of
+ *  gates on their longest path, as the sweep and event engines only settle
+ *  chains of about a dozen gates.
+ */
+typedef enum {adderdesign, shiftdesign, lfsrdesign, counterdesign, nanddesign, numdesigns} benchdesign;
+
+
+/** Returns the name of a kind of design, as used on the simbench command line.
+ *
+ * @param[in]  kind  The kind of design.
+ * @return     The name of the design.
+ */
+const char* designname(benchdesign kind);
+
+
+/** Looks up a kind of design by name.
+ *
+ * @param[in]  str   The name of the design.
+ * @param      kind  Returns the kind of design.
+ * @return     False if there is no design of that name.
+ */
+bool finddesign(const std::string& str, benchdesign& kind);
+
+
+/** Writes the definition file of a synthetic design, scaled to a number of
+ *  devices.
+ *
+ * @param[in]  kind      The kind of design.
+ * @param[in]  ndevices  The approximate number of devices to make.
+ * @param[in]  depth     The gates on the longest path of each adder or chain.
+ * @param[in]  nmonitors The most outputs to monitor, spread over the design.
+ * @return     The definition file, in the usual .matt syntax.
+ */
+std::string gennetwork(benchdesign kind, int ndevices, int depth, int nmonitors);
+
+
+#endif /* GF2_NETGEN_H */
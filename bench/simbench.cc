@@ -0,0 +1,196 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+
+#include "../com/localestrings.h"
+#include "../com/names.h"
+#include "../com/errorhandler.h"
+#include "../sim/network.h"
+#include "../sim/devices.h"
+#include "../sim/monitor.h"
+#include "../lang/scanner.h"
+#include "../lang/parser.h"
+
+#include "netgen.h"
+
+
+typedef std::chrono::steady_clock benchclock;
+
+static const char* const enginenames[] = {"sweep", "event", "levelized"};
+
+
+/** Returns the seconds between two times.
+ */
+static double seconds(benchclock::time_point from, benchclock::time_point to) {
+    return std::chrono::duration<double>(to - from).count();
+}
+
+
+/** Splits a comma separated list of positive numbers.
+ */
+static bool readsizes(const std::string& str, std::vector<int>& sizes) {
+    std::istringstream iss(str);
+    std::string word;
+    sizes.clear();
+    while (std::getline(iss, word, ',')) {
+        int n = std::atoi(word.c_str());
+        if (n <= 0)
+            return false;
+        sizes.push_back(n);
+    }
+    return !sizes.empty();
+}
+
+
+/** Times one synthetic design: parsing it, checking the network again on its
+ *  own, then simulating it with each engine, timing executedevices and
+ *  recordsignals separately. Prints one CSV row for each engine.
+ *
+ * @author Diesel
+ */
+static bool rundesign(benchdesign kind, int size, int depth, int cycles, int nmonitors,
+                      const std::vector<simengine>& engines, const char* writedir) {
+    std::string def = gennetwork(kind, size, depth, nmonitors);
+    if (writedir) {
+        std::string fname = std::string(writedir) + "/" + designname(kind) + "-" + std::to_string(size) + ".matt";
+        std::ofstream ofs(fname.c_str());
+        ofs << def;
+        if (!ofs) {
+            std::cerr << t("Could not write file") << ":      " << fname << std::endl;
+            return false;
+        }
+    }
+
+    names* nmz = new names();
+    network* netz = new network(nmz);
+    devices* dmz = new devices(nmz, netz);
+    monitor* mmz = new monitor(nmz, netz, dmz);
+    scanner* smz = new strscanner(nmz, def);
+    parser* pmz = new parser(netz, dmz, mmz, smz, nmz);
+
+    // parse, keeping the report out of the results
+    std::ostringstream report;
+    std::streambuf* out = std::cout.rdbuf(report.rdbuf());
+    benchclock::time_point t0 = benchclock::now();
+    bool ok = pmz->readin();
+    benchclock::time_point t1 = benchclock::now();
+    std::cout.rdbuf(out);
+    if (!ok)
+        std::cerr << report.str();
+
+    errorcollector errs;
+    benchclock::time_point t2 = benchclock::now();
+    netz->checknetwork(errs);
+    benchclock::time_point t3 = benchclock::now();
+
+    int ndevices = dmz->getkernel().devcount();
+    int n = cycles;
+    if (n <= 0)  // about 2*10^6 device evaluations per engine, within limits
+        n = std::max(20, std::min(maxcycles, 2000000 / ndevices));
+
+    for (unsigned int k = 0; k < engines.size() && ok; k++) {
+        simengine e = engines[k];
+        double exec = 0, record = 0;
+        int c;
+        dmz->setengine(e);
+        dmz->resetdevices();
+        mmz->resetmonitor();
+        for (c = 0; c < n && ok; c++) {
+            benchclock::time_point a = benchclock::now();
+            dmz->executedevices(ok);
+            benchclock::time_point b = benchclock::now();
+            mmz->recordsignals();
+            benchclock::time_point z = benchclock::now();
+            exec += seconds(a, b);
+            record += seconds(b, z);
+        }
+        std::cout << designname(kind) << "," << ndevices << "," << depth << "," << enginenames[e] << ","
+                  << seconds(t0, t1) * 1e3 << "," << seconds(t2, t3) * 1e3 << ","
+                  << c << "," << exec * 1e6 / c << "," << record * 1e6 / c << ","
+                  << (ok ? 1 : 0) << std::endl;
+        ok = true;
+    }
+
+    delete pmz;
+    delete smz;
+    delete mmz;
+    delete dmz;
+    delete netz;
+    delete nmz;
+    return ok;
+}
+
+
+/** Benchmarks the simulator on synthetic designs, see gennetwork, printing
+ *  CSV with one row for each design, size and engine:
+ *      parse_ms             parser::readin, including checks and compiling
+ *      check_ms             network::checknetwork on its own
+ *      exec_us_per_cycle    devices::executedevices
+ *      record_us_per_cycle  monitor::recordsignals
+ *      settled              0 if the design oscillated, ending the run early
+ *
+ * @author Diesel
+ */
+int main(int argc, char const *argv[]) {
+    LocaleStrings::AddTranslations("", "clisim");
+    LocaleStrings::AddTranslations("", "mattlang");
+
+    std::vector<benchdesign> kinds;
+    std::vector<int> sizes;
+    std::vector<simengine> engines;
+    const char* writedir = NULL;
+    int cycles = 0;
+    int depth = 8;
+    int nmonitors = 32;
+    bool usage = false;
+    for (int i = 1; i < argc && !usage; i++) {
+        std::string arg = argv[i];
+        benchdesign kind;
+        if (arg == "--design" && i + 1 < argc && finddesign(argv[i + 1], kind)) {
+            kinds.push_back(kind);
+            i++;
+        } else if (arg == "--engine" && i + 1 < argc) {
+            std::string e = argv[++i];
+            int k = 0;
+            while (k < 3 && e != enginenames[k])
+                k++;
+            usage = (k == 3);
+            engines.push_back((simengine) k);
+        } else if (arg == "--sizes" && i + 1 < argc)
+            usage = !readsizes(argv[++i], sizes);
+        else if (arg == "--depth" && i + 1 < argc)
+            usage = (depth = std::atoi(argv[++i])) <= 0;
+        else if (arg == "--cycles" && i + 1 < argc)
+            usage = (cycles = std::atoi(argv[++i])) <= 0;
+        else if (arg == "--monitors" && i + 1 < argc)
+            usage = (nmonitors = std::atoi(argv[++i])) < 0 || nmonitors > maxmonitors;
+        else if (arg == "--write" && i + 1 < argc)
+            writedir = argv[++i];
+        else
+            usage = true;
+    }
+    if (usage) {
+        std::cout << t("Usage") << ":      " << argv[0]
+                  << " [--design adder|shift|lfsr|counter|nand]... [--engine sweep|event|levelized]..."
+                  << " [--sizes n,n...] [--depth n] [--cycles n] [--monitors n] [--write dir]" << std::endl;
+        return 1;
+    }
+    if (kinds.empty())
+        for (int k = 0; k < numdesigns; k++)
+            kinds.push_back((benchdesign) k);
+    if (engines.empty())
+        engines = {sweepengine, eventengine, levelizedengine};
+    if (sizes.empty())
+        sizes = {1000, 10000, 100000};
+
+    std::cout << "design,devices,depth,engine,parse_ms,check_ms,cycles,exec_us_per_cycle,record_us_per_cycle,settled" << std::endl;
+    for (benchdesign kind : kinds)
+        for (int size : sizes)
+            if (!rundesign(kind, size, depth, cycles, nmonitors, engines, writedir))
+                return 1;
+    return 0;
+}
@@ -1,11 +1,18 @@
 
 #include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cstdlib>
 
 #include "../com/localestrings.h"
+#include "../com/formatstring.h"
 #include "../com/names.h"
 #include "../sim/network.h"
 #include "../sim/devices.h"
 #include "../sim/monitor.h"
+#include "../sim/bitsim.h"
 #include "../lang/scanner.h"
 #include "../lang/parser.h"
 
@@ -13,13 +20,134 @@
 
 
 
+/** Runs a batch of jobs read from a file, and prints the monitor traces of
+ *  each. Each line of the file is a job, giving the number of cycles to run
+ *  followed by any switch settings and clock periods, e.g.
+ *      20 SW1=1 SW2=0 CLK=3
+ *  Blank lines and lines starting with # are ignored. Jobs are simulated
+ *  bit-parallel, or one to a thread if the network has imported devices,
+ *  see bitsim::runbatch.
+ *
+ * @author Diesel
+ */
+static int runbatch(names* nmz, network* netz, devices* dmz, monitor* mmz,
+                    const char* jobfile, int nthreads) {
+    std::ifstream ifs(jobfile);
+    if (!ifs.is_open()) {
+        std::cerr << t("File not found") << ":      " << jobfile << std::endl;
+        return 1;
+    }
+
+    std::vector<batchjob> jobs;
+    std::vector<std::string> desc;
+    std::string line;
+    for (int ln = 1; std::getline(ifs, line); ln++) {
+        std::istringstream iss(line);
+        std::string word;
+        batchjob job;
+        if (!(iss >> word) || word[0] == '#')
+            continue;
+        job.cycles = std::atoi(word.c_str());
+        bool ok = job.cycles > 0;
+        while (ok && (iss >> word)) {
+            size_t eq = word.find('=');
+            devlink d = (eq == std::string::npos) ? NULL
+                : netz->finddevice(nmz->cvtname(word.substr(0, eq).c_str()));
+            int value = (eq == std::string::npos) ? -1 : std::atoi(word.c_str() + eq + 1);
+            if (d != NULL && d->kind == aswitch && (value == 0 || value == 1))
+                job.switches.push_back(std::make_pair(d->id, value ? high : low));
+            else if (d != NULL && (d->kind == aclock || d->kind == siggen) && value > 0)
+                job.clocks.push_back(std::make_pair(d->id, value));
+            else
+                ok = false;
+        }
+        if (!ok) {
+            std::cerr << jobfile << " (" << ln << "): " << t("Error: bad job") << ":      " << line << std::endl;
+            return 1;
+        }
+        jobs.push_back(job);
+        desc.push_back(line);
+    }
+
+    errorcollector errs;
+    bitsim bsim(nmz, netz, dmz, mmz);
+    std::vector<batchresult> results;
+    if (!bsim.runbatch(jobs, nthreads, results, errs)) {
+        errs.print(std::cerr);
+        return 1;
+    }
+
+    for (unsigned int j = 0; j < jobs.size(); j++) {
+        std::cout << "# " << desc[j] << std::endl;
+        for (unsigned int m = 0; m < results[j].traces.size(); m++)
+            mmz->displaytrace(m, results[j].traces[m]);
+        int limit = dmz->getsettle().limit;
+        for (int c : results[j].unsettled)
+            std::cout << t("Warning") << ": "
+                      << formatString(t("network did not settle within {0} machine cycles on cycle {1}"), limit, c + 1)
+                      << std::endl;
+        if (results[j].completed < jobs[j].cycles)
+            std::cout << t("Error") << ": "
+                      << formatString(t("network did not settle within {0} machine cycles on cycle {1}"), limit,
+                                      results[j].completed + 1)
+                      << std::endl;
+    }
+    return 0;
+}
+
+
 int main(int argc, char const *argv[]) {
     LocaleStrings::AddTranslations("", "clisim");
     LocaleStrings::AddTranslations("", "mattlang");
 
 
-    if (argc != 2) { // check we have one command line argument
-        std::cout << t("Usage") << ":      " << argv[0] << " [filename]" << std::endl;
+    // check we have a filename, and any options are valid
+    const char* filename = NULL;
+    const char* vcdfile = NULL;
+    const char* jobfile = NULL;
+    int nthreads = 0;
+    settleoptions settle;
+    bool flatten = false;
+    bool stats = false;
+    bool usage = false;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--vcd" && i + 1 < argc)
+            vcdfile = argv[++i];
+        else if (arg == "--batch" && i + 1 < argc)
+            jobfile = argv[++i];
+        else if (arg == "--threads" && i + 1 < argc)
+            nthreads = std::atoi(argv[++i]);
+        else if (arg == "--settle" && i + 1 < argc) {
+            settle.limit = std::atoi(argv[++i]);
+            if (settle.limit < 1 || settle.limit > maxsettlelimit)
+                usage = true;
+        }
+        else if (arg == "--unsettled" && i + 1 < argc) {
+            std::string p = argv[++i];
+            if (p == "abort")
+                settle.policy = abortpolicy;
+            else if (p == "indet")
+                settle.policy = indetpolicy;
+            else if (p == "continue")
+                settle.policy = continuepolicy;
+            else
+                usage = true;
+        }
+        else if (arg == "--periodic")
+            settle.criterion = periodicconverge;
+        else if (arg == "--flatten")
+            flatten = true;
+        else if (arg == "--stats")
+            stats = true;
+        else if (filename == NULL && arg[0] != '-')
+            filename = argv[i];
+        else
+            usage = true;
+    }
+    if (usage || filename == NULL) {
+        std::cout << t("Usage") << ":      " << argv[0] << " [--flatten] [--stats] [--settle n] [--unsettled abort|indet|continue] [--periodic]"
+                  << " [--vcd vcdfile] [--batch jobfile [--threads n]] [filename]" << std::endl;
         return 1;
     }
 
@@ -27,20 +155,34 @@ int main(int argc, char const *argv[]) {
     names* nmz = new names();
     network* netz = new network(nmz);
     devices* dmz = new devices(nmz, netz);
-    monitor* mmz = new monitor(nmz, netz);
+    dmz->setsettle(settle);
+    monitor* mmz = new monitor(nmz, netz, dmz);
     fscanner* smz = new fscanner(nmz);
-    if (smz->open(argv[1])) {
+    if (smz->open(filename)) {
         parser* pmz = new parser(netz, dmz, mmz, smz, nmz);
 
         if (pmz->readin ()) { // check the logic file parsed correctly
-            // Construct the text-based interface
-            userint umz(nmz, dmz, mmz);
-            umz.userinterface();
+            if (flatten)
+                dmz->flatten();
+            if (jobfile) {
+                ret = runbatch(nmz, netz, dmz, mmz, jobfile, nthreads);
+            } else if (vcdfile && !mmz->startvcd(vcdfile)) {
+                std::cerr << t("Could not open VCD file") << ":      " << vcdfile << std::endl;
+                ret = 1;
+            } else {
+                // Construct the text-based interface
+                userint umz(nmz, dmz, mmz);
+                if (stats)
+                    umz.profile(true);
+                umz.userinterface();
+                if (stats)
+                    umz.showprofile();
+            }
         }
 
         delete pmz;
     } else {
-        std::cerr << t("File not found") <<  ":      " << argv[1] << std::endl;
+        std::cerr << t("File not found") <<  ":      " << filename << std::endl;
         ret = 1;
     }
 
@@ -1,5 +1,6 @@
 
 #include <iostream>
+#include <fstream>
 #include <cctype>
 
 #include "../com/localestrings.h"
@@ -115,7 +116,7 @@ void userint::rdname (name& n)
     Token tk = scan.step();
 
     if (tk.type != TokType::Identifier) {
-      throw mattsemanticerror(t("Expecting identifer."), SourcePos(1, cmdpos));
+      throw mattsemanticerror(t("Expecting identifer."), tk.at);
     }
 
     n = tk.id;
@@ -142,7 +143,7 @@ void userint::rdqualname (name& prefix, name& suffix)
     Token tk = scan.step();
 
     if (tk.type != TokType::Identifier) {
-      throw mattsemanticerror(t("Expecting identifer."), SourcePos(1, cmdpos, cmdpos));
+      throw mattsemanticerror(t("Expecting identifer."), tk.at);
     }
 
     prefix = tk.id;
@@ -154,7 +155,7 @@ void userint::rdqualname (name& prefix, name& suffix)
       tk = scan.step();
 
       if (tk.type != TokType::Identifier) {
-        throw mattsemanticerror(t("Expecting pin identifer."), SourcePos(1, cmdpos, cmdpos));
+        throw mattsemanticerror(t("Expecting pin identifer."), tk.at);
       }
 
       suffix = tk.id;
@@ -172,6 +173,23 @@ void userint::rdqualname (name& prefix, name& suffix)
 }
 
 
+/***********************************************************************
+ *
+ * Read the rest of the input text string as a file name, which is empty
+ * if there is none.
+ *
+ */
+void userint::rdfname (string& fname)
+{
+  skip ();
+  fname.assign (&cmdline[cmdpos], cmdlen - cmdpos);
+  while (!fname.empty () && fname[fname.size () - 1] == ' ')
+    fname.erase (fname.size () - 1);
+  if (curch == '\0')
+    fname.clear ();
+}
+
+
 /***********************************************************************
  *
  * The 's' command.
@@ -206,14 +224,23 @@ void userint::setswcmd (void)
 void userint::runnetwork (int ncycles)
 {
   bool ok = true;
-  int n = ncycles;
+  int n = ncycles, idle;
   while ((n > 0) && ok) {
+    // jump over cycles in which nothing changes, recording them in one go
+    idle = dmz->skipidle (n);
+    if (idle > 0) {
+      n -= idle;
+      mmz->recordsignals (idle);
+      continue;
+    }
     dmz->executedevices (ok);
+    cycleresult r = dmz->lastcycle ();
+    if (! ok || r == oscillatingcycle || r == limitcycle)
+      showunsettled (cyclescompleted + ncycles - n + 1, ok);
     if (ok) {
       n--;
       mmz->recordsignals ();
-    } else
-      cout << t("Error: network is oscillating") << endl;
+    }
   }
   if (ok) {
     mmz->displaysignals ();
@@ -223,6 +250,50 @@ void userint::runnetwork (int ncycles)
 }
 
 
+/***********************************************************************
+ *
+ * Reports a cycle which did not settle, as an error if the run stops
+ * there, otherwise as a warning.
+ *
+ */
+void userint::showunsettled (int cycle, bool ok)
+{
+  string what;
+  if (dmz->lastcycle () == oscillatingcycle)
+    what = formatString (t("network is oscillating on cycle {0}"), cycle);
+  else
+    what = formatString (t("network did not settle within {0} machine cycles on cycle {1}"),
+                         dmz->getsettle ().limit, cycle);
+  if (! ok) {
+    cout << t("Error") << ": " << what << endl;
+    showoscillation ();
+  } else if (dmz->getsettle ().policy == indetpolicy)
+    cout << t("Warning") << ": " << what << ", " << t("outputs still changing set to indet") << endl;
+  else
+    cout << t("Warning") << ": " << what << endl;
+}
+
+
+/***********************************************************************
+ *
+ * Show where the devices found oscillating are defined.
+ *
+ */
+void userint::showoscillation (void)
+{
+  const unsigned int maxshown = 10;
+  vector<devlink> devs;
+  errorcollector errs;
+  dmz->oscillating (devs);
+  for (unsigned int k = 0; k < devs.size () && k < maxshown; k++)
+    errs.report (mattruntimeerror (formatString (t("{0} is oscillating"), nmz->namestr (devs[k]->id)),
+                                   devs[k]->definedAt));
+  errs.print (cout);
+  if (devs.size () > maxshown)
+    cout << formatString (t("and {0} more devices"), devs.size () - maxshown) << endl;
+}
+
+
 /***********************************************************************
  *
  * The 'r' command.
@@ -278,7 +349,8 @@ void userint::setmoncmd (void)
 {
   name dev, outp;
   rdqualname (dev, outp);
-  mmz->makemonitor (dev, outp, cmdok);
+  if (cmdok)
+    mmz->makemonitor (dev, outp, cmdok);
   if (cmdok)
     cyclescompleted = 0;
   else
@@ -327,6 +399,208 @@ void userint::debugcmd (void)
 }
 
 
+/***********************************************************************
+ *
+ * The 'e' command.
+ * Selects the simulation engine used by the devices module.
+ *
+ */
+void userint::enginecmd (void)
+{
+  int n;
+  rdnumber (n, 0, 2);
+  if (cmdok) {
+    if (n == 2) {
+      dmz->setengine (levelizedengine);
+      cout << t("Using the levelized engine") << endl;
+    } else if (n == 1) {
+      dmz->setengine (eventengine);
+      cout << t("Using the event driven engine") << endl;
+    } else {
+      dmz->setengine (sweepengine);
+      cout << t("Using the sweep engine") << endl;
+    }
+  }
+}
+
+
+/***********************************************************************
+ *
+ * The 'l' command.
+ * Sets how each cycle settles: the most machine cycles run, what to do
+ * with a cycle which does not settle, and whether a loop counts as
+ * settled. Shows the settings if no number is given.
+ *
+ */
+void userint::settlecmd (void)
+{
+  int n;
+  settleoptions opts = dmz->getsettle ();
+  skip ();
+  if (isdigit (curch)) {
+    rdnumber (n, 1, maxsettlelimit);
+    if (cmdok)
+      opts.limit = n;
+    skip ();
+    if (cmdok && isdigit (curch)) {
+      rdnumber (n, 0, 2);
+      opts.policy = (settlepolicy) n;
+      skip ();
+    }
+    if (cmdok && isdigit (curch)) {
+      rdnumber (n, 0, 1);
+      opts.criterion = (convergence) n;
+    }
+    if (! cmdok)
+      return;
+    dmz->setsettle (opts);
+  }
+  cout << formatString (t("Cycles settle within {0} machine cycles"), opts.limit) << endl;
+  if (opts.criterion == periodicconverge)
+    cout << t("Signals going round a loop count as settled") << endl;
+  if (opts.policy == indetpolicy)
+    cout << t("Outputs still changing are set to indet when a cycle does not settle") << endl;
+  else if (opts.policy == continuepolicy)
+    cout << t("The simulation continues when a cycle does not settle") << endl;
+  else
+    cout << t("The simulation stops when a cycle does not settle") << endl;
+}
+
+
+/***********************************************************************
+ *
+ * The 'v' command.
+ * Starts dumping the monitored signals to a VCD file, or stops if no file
+ * is given.
+ *
+ */
+void userint::vcdcmd (void)
+{
+  string fname;
+  rdfname (fname);
+  if (fname.empty ()) {
+    mmz->stopvcd ();
+    cout << t("Stopped writing VCD file") << endl;
+  } else if (mmz->startvcd (fname)) {
+    cout << formatString(t("Writing monitored signals to {0}"), fname) << endl;
+  } else {
+    cmdok = false;
+    cout << formatString(t("Error: could not open {0}"), fname) << endl;
+  }
+}
+
+
+/***********************************************************************
+ *
+ * The 'k' command.
+ * Keeps a checkpoint of the simulation, which 'b' goes back to, and writes
+ * it to a file if one is given.
+ *
+ */
+void userint::keepcmd (void)
+{
+  string fname;
+  rdfname (fname);
+  if (cyclescompleted == 0) {
+    cmdok = false;
+    cout << t("Error: nothing to checkpoint!") << endl;
+    return;
+  }
+  kept.take (dmz, mmz, cyclescompleted);
+  if (fname.empty ()) {
+    cout << formatString(t("Checkpoint kept after {0} cycles"), cyclescompleted) << endl;
+    return;
+  }
+  ofstream out (fname.c_str (), ios::binary);
+  cmdok = kept.write (dmz, out);
+  if (cmdok)
+    cout << formatString(t("Checkpoint written to {0}"), fname) << endl;
+  else
+    cout << formatString(t("Error: could not write {0}"), fname) << endl;
+}
+
+
+/***********************************************************************
+ *
+ * The 'b' command.
+ * Goes back to the checkpoint kept by 'k', first reading it from a file if
+ * one is given.
+ *
+ */
+void userint::backcmd (void)
+{
+  string fname;
+  rdfname (fname);
+  if (!fname.empty ()) {
+    ifstream in (fname.c_str (), ios::binary);
+    if (!kept.read (dmz, in)) {
+      cmdok = false;
+      cout << formatString(t("Error: {0} is not a checkpoint of this network"), fname) << endl;
+      return;
+    }
+  }
+  int n = kept.restore (dmz, mmz);
+  cmdok = (n >= 0);
+  if (cmdok) {
+    cyclescompleted = n;
+    cout << formatString(t("Back to the checkpoint after {0} cycles"), n) << endl;
+    mmz->displaysignals ();
+  } else
+    cout << t("Error: no checkpoint to go back to!") << endl;
+}
+
+
+/***********************************************************************
+ *
+ * The 'p' command.
+ * Turns profiling on and off, or shows the profile if no number is given.
+ *
+ */
+void userint::profilecmd (void)
+{
+  int n;
+  skip ();
+  if (! isdigit (curch)) {
+    showprofile ();
+    return;
+  }
+  rdnumber (n, 0, 1);
+  if (cmdok) {
+    profile (n == 1);
+    if (n == 1)
+      cout << t("Profiling is on") << endl;
+    else
+      cout << t("Profiling is off") << endl;
+  }
+}
+
+
+/***********************************************************************
+ *
+ * Starts profiling the simulation afresh, or stops it, keeping the
+ * counters to show.
+ *
+ */
+void userint::profile (bool on)
+{
+  if (on)
+    stats.clear ();
+  dmz->profile (on ? &stats : NULL);
+  mmz->profile (on ? &stats : NULL);
+}
+
+
+/***********************************************************************
+ *
+ * Prints the counters collected while profiling.
+ *
+ */
+void userint::showprofile (void)
+{
+  stats.print (cout, dmz->getsettle ().limit);
+}
+
+
 /***********************************************************************
  *
  * The 'h' command.
@@ -344,6 +618,13 @@ void userint::helpcmd (void)
   cout << "m X       - " << t("set a monitor on signal X") << endl;
   cout << "z X       - " << t("zap the monitor on signal X") << endl;
   cout << "d N       - " << t("set debugging on (N=1) or off (N=0)") << endl;
+  cout << "e N       - " << t("use the sweep (N=0), event driven (N=1) or levelized (N=2) engine") << endl;
+  cout << "l [N A C] - " << t("settle within N machine cycles, then stop (A=0), set indet (A=1) or continue (A=2),") << endl;
+  cout << "            " << t("counting loops as settled if C=1; show the settings if omitted") << endl;
+  cout << "v FILE    - " << t("write monitored signals to VCD file FILE, or stop if omitted") << endl;
+  cout << "k [FILE]  - " << t("keep a checkpoint of the simulation, and write it to FILE if given") << endl;
+  cout << "b [FILE]  - " << t("go back to the checkpoint, or one read from FILE") << endl;
+  cout << "p [N]     - " << t("set profiling on (N=1) or off (N=0), or show the profile") << endl;
   cout << "h         - " << t("help (this command)") << endl;
   cout << "q         - " << t("quit the program") << endl;
   cout << endl;
@@ -365,8 +646,8 @@ void userint::userinterface (void)
     /* The next two lines create a 'set' of characters which are */
     /* characters that can form valid commands.                  */
     /* See the standard templates library for more information.  */
-    char poscm[] = {'s','r','c','d','z','m','h','q'};
-    charset cmset(poscm, poscm + 8);
+    char poscm[] = {'s','r','c','d','e','l','v','k','b','p','z','m','h','q'};
+    charset cmset(poscm, poscm + 14);
     rdcmd (cmd, cmset);
     if (cmdok)
       switch (cmd) {
@@ -376,6 +657,12 @@ void userint::userinterface (void)
       case 'm': setmoncmd ();   break;
       case 'z': zapmoncmd ();   break;
       case 'd': debugcmd ();    break;
+      case 'e': enginecmd ();   break;
+      case 'l': settlecmd ();   break;
+      case 'v': vcdcmd ();      break;
+      case 'k': keepcmd ();     break;
+      case 'b': backcmd ();     break;
+      case 'p': profilecmd ();  break;
       case 'h': helpcmd ();     break;
       case 'q':                 break;
       }
@@ -7,6 +7,8 @@
 #include "../sim/network.h"
 #include "../sim/devices.h"
 #include "../sim/monitor.h"
+#include "../sim/checkpoint.h"
+#include "../sim/simstats.h"
 
 using namespace std;
 
@@ -28,6 +30,8 @@ class userint {
   char curch;              // Current character.
   char cmd;                // Command to be executed.
   int cyclescompleted;     // Simulation cycles completed.
+  checkpoint kept;         // Snapshot taken by the 'k' command.
+  simstats stats;          // Counters kept while profiling.
 
   void readline (void);
   void getch (void);
@@ -36,19 +40,34 @@ class userint {
   void rdnumber (int& n, int lo, int hi);
   void rdname (name& n);
   void rdqualname (name& prefix, name& suffix);
+  void rdfname (string& fname);
   void setswcmd (void);
   void runnetwork (int ncycles);
+  void showunsettled (int cycle, bool ok);
+  void showoscillation (void);
   void runcmd (void);
   void continuecmd (void);
   void setmoncmd (void);
   void zapmoncmd (void);
   void debugcmd (void);
+  void enginecmd (void);
+  void settlecmd (void);
+  void vcdcmd (void);
+  void keepcmd (void);
+  void backcmd (void);
+  void profilecmd (void);
   void helpcmd (void);
 
  public:
   void userinterface (void);
   /* Implements the interactive user command interface.                 */
 
+  void profile (bool on);
+  /* Starts profiling the simulation afresh, or stops it.               */
+
+  void showprofile (void);
+  /* Prints the counters collected while profiling.                     */
+
   userint (names* names_mod, devices* devices_mod, monitor* monitor_mod);
   /* Constructor for the userint module.                                */
 };
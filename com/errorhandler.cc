@@ -2,7 +2,6 @@
 #include <string>
 #include <exception>
 #include <sstream>
-#include <fstream>
 #include <ostream>
 #include <iomanip>
 #include <algorithm>
@@ -55,7 +54,7 @@ const SourcePos& mattmessage::pos() const {
 }
 
 
-/// Reads the source file, and gets the line the error occured on.
+/// Gets the line the error occured on from the cached source of the file.
 std::string mattmessage::getErrorLine(int cmax) {
 
     cmax -= 4;
@@ -65,46 +64,42 @@ std::string mattmessage::getErrorLine(int cmax) {
     }
 
 
-    if (_pos.fileStr().empty()) {
+    // Positions without a file are only within a string when they're not 0
+    if (_pos.fileStr().empty() && _pos.Abs == 0) {
         return "";
     }
 
-    try {
-        std::ifstream ifs;
-        ifs.open(_pos.fileStr(), std::ifstream::in | std::ifstream::binary);
+    const char* begin = NULL;
+    const char* end = NULL;
+    _pos.source(begin, end);
 
-        int p = _pos.Abs - _pos.Column;
-        int c = _pos.Column;
+    int c = _pos.column();
+    int p = _pos.Abs - c;
 
-        if (_pos.Column > cmax) {
-            p = _pos.Abs - cmax;
-            c = cmax;
-        }
+    if (c > cmax) {
+        p = _pos.Abs - cmax;
+        c = cmax;
+    }
 
-        ifs.clear();
-        ifs.seekg(p);
+    const char* s = begin + std::min(std::max(p, 0), int(end - begin));
 
-        while (std::isspace(ifs.peek())) {
-            ifs.get();
-            c--;
-        }
+    while (s != end && std::isspace((unsigned char) *s)) {
+        s++;
+        c--;
+    }
 
-        std::getline(ifs, _srcLine);
+    _srcLine.assign(s, std::find(s, end, '\n'));
 
-        if ((int)_srcLine.length() > cmax) {
-            int A = std::max(0, c - cmax/2);
-            int B = std::min(A+cmax, int(_srcLine.length()));
-            A = std::max(0, B-cmax);
+    if ((int)_srcLine.length() > cmax) {
+        int A = std::max(0, c - cmax/2);
+        int B = std::min(A+cmax, int(_srcLine.length()));
+        A = std::max(0, B-cmax);
 
-            c = c-A;
-            _srcLine = "... " + _srcLine.substr(A, B-A);
-            c += 4;
-        }
-        _srcLineErrCol = c;
-    }
-    catch (...) {
-        _srcLine = "(error getting source line)";
+        c = c-A;
+        _srcLine = "... " + _srcLine.substr(A, B-A);
+        c += 4;
     }
+    _srcLineErrCol = c;
 
     return _srcLine;
 }
@@ -159,7 +154,7 @@ std::string mattmessage::formatMessage(int cmax) {
     if (!_fname.empty())
         oss << _fname << " ";
 
-    oss << "(" << _pos.Line << ":" << _pos.Column << "): ";
+    oss << "(" << _pos.line() << ":" << _pos.column() << "): ";
     int p = oss.tellp() - cls;
 
     if (_type == MsgError)
@@ -14,7 +14,7 @@
  * @author Diesel
  */
 iposstream::iposstream()
-	: Pos( ), TabWidth( 1 ), _open(false), next( "", 1, 1, 1 ) {
+	: TabWidth( 1 ), _open(false), Pos( ), next( "", 1 ), _cur(NULL) {
 }
 
 /** Creates a positional stream based on an input stream.
@@ -22,11 +22,12 @@ iposstream::iposstream()
  * @author Diesel
  */
 iposstream::iposstream( std::istream* base )
-	: Pos( ), TabWidth( 1 ), _open(true), basestream( base ), next( "", 1, 1, 1 ) {
+	: TabWidth( 1 ), _open(true), basestream( base ), Pos( ), next( "", 1 ), _cur(NULL) {
 }
 
 iposstream::iposstream( std::istream* base, std::string fname )
-	: Pos( fname, 0, 0, 0 ), TabWidth( 1 ), _open(true), basestream( base ), next( fname, 1, 1, 1 ) {
+	: TabWidth( 1 ), _open(true), basestream( base ), Pos( fname ), next( fname, 1 ), _cur(NULL) {
+	next.startSource();
 }
 
 /** Clears resources allocated by the iposstream
@@ -42,6 +43,13 @@ iposstream::~iposstream() {
  * @author Diesel
  */
 int iposstream::peek() {
+	if ( _cur ) {
+		if ( _cur == _end ) {
+			_eof = true;
+			return( std::char_traits<char>::eof() );
+		}
+		return( (unsigned char) *_cur );
+	}
 	return( basestream->peek() );
 }
 
@@ -54,6 +62,22 @@ int iposstream::peek() {
  * @author Diesel
  */
 int iposstream::get() {
+	if ( _cur ) {
+		_at = _cur;
+		if ( _cur == _end ) {
+			_eof = true;
+			return '\0';
+		}
+
+		int ret = (unsigned char) *_cur++;
+		if ( ret == '\r' ) {
+			if ( _cur != _end && *_cur == '\n' )
+				_cur++;
+			ret = '\n';
+		}
+		return( ret );
+	}
+
 	this->Pos = next;
 
 	if (basestream->eof()) {
@@ -63,32 +87,24 @@ int iposstream::get() {
 	int ret = basestream->get();
 	this->next.Abs += 1;
 
+	// Keep the source, which can't be read again from a stream
+	if ( ret == std::char_traits<char>::eof() ) {
+		this->next.endSource();
+		return( ret );
+	}
+	this->next.addSource( ret );
+
 	// Handle \r\n sequence, required when using windows line endings on a non
 	// windows operating system.
 	if ( ret == '\r' ) {
 		if ( this->peek() == '\n' ) {
-			basestream->get();
+			this->next.addSource( basestream->get() );
 			this->next.Abs += 1;
 		}
 
 		ret = '\n';
 	}
 
-	// Eol characters are reported at the end of the line, rather than at the
-	// beginning of the next
-	if ( ret == '\n' ) {
-		this->next.Line += 1;
-		this->next.Column = 1;
-		// this->next.LineStart = this->next.Abs + 1;
-	}
-	// else if ( ret == '\t' ) { // Tab is not always counted as 1 character.
-	// 	this->next.Abs += this->TabWidth - 1;
-	// 	this->next.Column += this->TabWidth;
-	// }
-	else {
-		this->next.Column += 1;
-	}
-
 	return( ret );
 }
 
@@ -98,6 +114,8 @@ int iposstream::get() {
  * @author Diesel
  */
 bool iposstream::eof() const {
+	if ( _cur )
+		return( _eof );
 	return( basestream->eof() );
 }
 
@@ -108,6 +126,7 @@ bool iposstream::eof() const {
  */
 void iposstream::setStream(std::istream* is) {
 	basestream = is;
+	_cur = NULL;
 	_open = true;
 }
 
@@ -115,4 +134,57 @@ void iposstream::setStream(std::istream* is, std::string fname) {
 	setStream(is);
 	Pos.setFile(fname);
 	next.setFile(fname);
+	next.startSource();
+}
+
+
+/** Reads from a buffer in memory instead of a stream.
+ *
+ * @author Diesel
+ */
+void iposstream::setBuffer(const char* begin, const char* end, std::string fname) {
+	basestream = NULL;
+	_begin = _cur = begin;
+	_at = NULL;
+	_end = end;
+	_eof = false;
+	_open = true;
+	Pos = SourcePos( fname );
+	next.setFile(fname);
+}
+
+
+/** Returns the unread characters, if the stream is based on a buffer.
+ *
+ * @author Diesel
+ */
+const char* iposstream::buffer(const char*& end) const {
+	end = _end;
+	return( _cur );
+}
+
+
+/** Extracts the characters of the buffer before p.
+ *
+ * @author Diesel
+ */
+void iposstream::extract(const char* p) {
+	if ( p > _cur ) {
+		_at = p - 1;
+		_cur = p;
+	}
+}
+
+
+/** Returns the position of the last character extracted
+ *
+ * @author Diesel
+ */
+SourcePos iposstream::pos() {
+	if ( !_cur || !_at )
+		return( Pos );
+
+	SourcePos ret = Pos;
+	ret.Abs = _at - _begin + 1;
+	return( ret );
 }
@@ -10,6 +10,8 @@
 
 
 /** Wraps an input character stream, whilst tracking source position.
+ *  When reading from a stream, the characters read are kept as the source of
+ *  the file, see SourcePos::startSource.
  *
  * @author Diesel
  */
@@ -50,15 +52,49 @@ public:
 	void setStream(std::istream* is);
 	void setStream(std::istream* is, std::string fname );
 
-	/** The current position of the stream
+	/** Reads from a buffer in memory instead of a stream, e.g. a mapped file.
+	 *  Only a pointer into the buffer is moved as characters are read.
+	 *
+	 * @param      begin  The first character of the buffer
+	 * @param      end    One past the last character of the buffer
+	 * @param      fname  The file name
 	 */
-	SourcePos Pos;
+	void setBuffer(const char* begin, const char* end, std::string fname);
+
+	/** Returns the unread characters, if the stream is based on a buffer.
+	 *
+	 * @param      end   Returns one past the last character of the buffer.
+	 * @return     The next character, or NULL if based on a stream.
+	 */
+	const char* buffer(const char*& end) const;
+
+	/** Extracts the characters of the buffer before p, which must not include
+	 *  a line ending.
+	 *
+	 * @param      p     One past the last character to extract.
+	 */
+	void extract(const char* p);
+
+	/** Returns the position of the last character extracted
+	 *
+	 * @return     The current position of the stream
+	 */
+	SourcePos pos();
+
 	int TabWidth;
 
 private:
 	bool _open;
 	std::istream* basestream;
+	SourcePos Pos;
 	SourcePos next;
+
+	// Used when based on a buffer
+	const char* _begin;
+	const char* _cur;         // next character
+	const char* _end;
+	const char* _at;          // last character extracted, or NULL, see pos
+	bool _eof;
 };
 
 
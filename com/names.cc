@@ -1,31 +1,103 @@
 
-#include <set>
+#include <cctype>
 
 #include "names.h"
 
 
-const name blankname;
 const namestring blanknamestr = "(blank)";
 
 
+/** Hashes a name id, which is already a small unique integer.
+ *
+ * @author Diesel
+ */
+size_t namehash::operator() (name id) const
+{
+	return id;
+}
+
+
 /** Initialises the name table.
  *
  * @author Diesel
  */
-names::names(void) {
+names::names(void)
+	: _strings(1, blanknamestr), _hashes(1, 0), _slots(64, blankname) {
+}
+
+
+/** Hashes a string, ignoring case, using FNV-1a on the upper case characters.
+ *
+ * @author Diesel
+ */
+size_t names::hash (const char* s, size_t n)
+{
+	size_t h = 2166136261u;
+	for (size_t i = 0; i < n; i++) {
+		h ^= (unsigned char) std::toupper((unsigned char) s[i]);
+		h *= 16777619u;
+	}
+	return h;
+}
+
+
+/** Finds the slot of a string in the table, probing linearly from its hash.
+ *
+ * @author Diesel
+ */
+size_t names::findslot (const char* s, size_t n, size_t h) const
+{
+	size_t mask = _slots.size() - 1;
+	for (size_t i = h & mask;; i = (i + 1) & mask) {
+		name id = _slots[i];
+		if (id == blankname)
+			return i;
+		if (_hashes[id] == h && _strings[id].length() == n
+				&& ci_char_traits::compare(_strings[id].data(), s, n) == 0)
+			return i;
+	}
 }
 
 
 /** Returns the internal representation of the name given in character form.
- *  If the name doesn't already exist in the table it is added.
+ *  If the name doesn't already exist in the table it is added. The table is
+ *  kept at most half full, so probes stay short.
  *
  * @author Diesel
  */
-name names::lookup (namestring str)
+name names::lookup (const char* s, size_t n)
 {
-	if (str == "") return blankname;
+	if (n == 0) return blankname;
+
+	size_t h = hash(s, n);
+	size_t i = findslot(s, n, h);
+	if (_slots[i] != blankname)
+		return _slots[i];
+
+	name id = name(_strings.size());
+	_strings.emplace_back(s, n);
+	_hashes.push_back(h);
+	_slots[i] = id;
+
+	if (_strings.size() * 2 > _slots.size()) {
+		std::vector<name> old(_slots.size() * 2, blankname);
+		old.swap(_slots);
+		size_t mask = _slots.size() - 1;
+		for (name o : old) {
+			if (o == blankname)
+				continue;
+			size_t j = _hashes[o] & mask;
+			while (_slots[j] != blankname)
+				j = (j + 1) & mask;
+			_slots[j] = o;
+		}
+	}
+	return id;
+}
 
-	return _nameSet.insert(str).first;
+name names::lookup (namestring str)
+{
+	return lookup(str.data(), str.length());
 }
 
 
@@ -37,7 +109,7 @@ name names::cvtname (namestring str)
 {
 	if (str == "") return blankname;
 
-	return _nameSet.find(str);
+	return _slots[findslot(str.data(), str.length(), hash(str.data(), str.length()))];
 }
 
 
@@ -46,7 +118,7 @@ name names::cvtname (namestring str)
  * @author Diesel
  */
 const namestring& names::namestr(name id) const {
-	return (id == blankname) ? blanknamestr : *id;
+	return _strings[id];
 }
 
 
@@ -59,5 +131,15 @@ int names::namelength (name id)
 	if (id == blankname)
 		return 0;
 
-	return id->length();
+	return _strings[id].length();
+}
+
+
+/** Returns the number of ids handed out, including blankname.
+ *
+ * @author Diesel
+ */
+size_t names::size () const
+{
+	return _strings.size();
 }
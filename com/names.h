@@ -1,32 +1,59 @@
-
 #ifndef GF2_NAMES_H
 #define GF2_NAMES_H
 
-#include <set>
+#include <deque>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
 
 #include "cistring.h"
 
 
 typedef cistring namestring;
-typedef std::set<namestring>::const_iterator name;
 
-extern const name blankname;       /* special name (defaults to end iterator)*/
+/** Name ids are dense integers counting up from 1 in the order the names are
+ *  added to the table, so they can be used to index arrays directly. Being an
+ *  enum, a name converts to an integer implicitly, but not the other way.
+ */
+enum name : std::uint32_t { };
+
+const name blankname = name(0);    /* special name, the default name */
 extern const namestring blanknamestr;
 
+
+/** Hash function for name ids, for use in unordered containers.
+ *
+ *  @author Diesel
+ */
+struct namehash {
+  size_t operator() (name id) const;
+};
+
 /** Names Table Class
  *
- * Stores the names using the STL `std::set` container.
+ * Stores the names in a hash table, keyed on the case-folded string.
  * The type stored is `cistring`, which is a case-insensitive variant on `std::string`.
- * Name IDs are in fact `const_iterator`s to items in the set, it's worth noting that
- *   the standard enforces that changes to the set won't change an items iterator.
- * `blankname` is a special case, stored as the `end()` iterator of the set. This
- *   cannot be dereferenced or used like the other iterators.
+ * Name IDs are the indices of the strings in the table, which are kept in a
+ *   deque so that references to them stay valid as names are added.
+ * `blankname` is a special case, id 0, which is never added to the table.
  *
  *  @author Gee, Diesel
  */
 class names{
 private:
-  std::set<namestring> _nameSet;
+  std::deque<namestring> _strings;  // indexed by id, with blanknamestr at 0
+  std::vector<size_t> _hashes;      // hash of each string, indexed by id
+  std::vector<name> _slots;         // open addressed, blankname if empty
+
+  /** Hashes a string, ignoring case.
+   */
+  static size_t hash (const char* s, size_t n);
+
+  /** Finds the slot of a string in the table.
+   *
+   * @return     The slot holding the name, or the empty slot it would go in.
+   */
+  size_t findslot (const char* s, size_t n, size_t h) const;
 
 public:
   /** Returns the internal representation of the name given in character form.
@@ -36,6 +63,7 @@ public:
    * @return     The name's identifier.
    */
   name lookup (namestring str);
+  name lookup (const char* s, size_t n);
 
   /** Returns the internal representation of the name given in character form.
    *
@@ -59,6 +87,11 @@ public:
    */
   int namelength (name id);
 
+  /** Returns the number of ids handed out, including blankname, which is the
+   *  size of an array indexed by name.
+   */
+  size_t size () const;
+
   /** Initialises the name table.
    */
   names (void);
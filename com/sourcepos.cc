@@ -1,35 +1,33 @@
 
 
 #include <ostream>
+#include <fstream>
+#include <iterator>
 #include <string>
-#include <set>
+#include <vector>
+#include <algorithm>
+#include <mutex>
 #include "sourcepos.h"
 
 
 // struct SourcePos
 
-std::set<std::string> SourcePos::fileNames;
+std::deque<SourcePos::fileinfo> SourcePos::files = {{"", NULL, NULL, 0, "", true, true, {1}, 0}};
+
+// guards files, and is recursive as the functions below call each other
+static std::recursive_mutex fileslock;
+typedef std::lock_guard<std::recursive_mutex> fileguard;
 
 /**
  *
  * @author Diesel
  */
 SourcePos::SourcePos()
-    : SourcePos( "", 0, 0, 0 ) {
-}
-
-SourcePos::SourcePos(int line, int col)
-    : SourcePos( "", line, col, 0 ) {
-}
-
-SourcePos::SourcePos(int line, int col, int abs)
-    : SourcePos( "", line, col, abs ) {
+    : File( 0 ), Abs( 0 ) {
 }
 
-SourcePos::SourcePos( std::string file, int line, int col, int abs )
+SourcePos::SourcePos( std::string file, int abs )
 	: File(getFile(file)),
-      Line( line ),
-	  Column( col ),
 	  Abs( abs ) {
 }
 
@@ -39,7 +37,8 @@ SourcePos::SourcePos( std::string file, int line, int col, int abs )
  * @author Diesel
  */
 const std::string& SourcePos::fileStr() const {
-    return *File;
+    fileguard guard(fileslock);
+    return files[File].name;
 }
 
 
@@ -52,12 +51,177 @@ void SourcePos::setFile(std::string f) {
 }
 
 
-/** Returns an iterator the the file name within the set
+/** Returns the index of a file in the file table, adding it if needed.
+ *  There are only ever a handful of files, so they are searched in turn.
+ *
+ * @author Diesel
+ */
+int SourcePos::getFile(std::string f) {
+    fileguard guard(fileslock);
+    for (unsigned int n = 0; n < files.size(); n++) {
+        if (files[n].name == f)
+            return n;
+    }
+    files.push_back({f, NULL, NULL, 0, "", false, false, {1}, 0});
+    return files.size() - 1;
+}
+
+
+/** Returns the source of a file, reading the file if it isn't cached.
+ *
+ * @author Diesel
+ */
+bool SourcePos::source(int f, const char*& begin, const char*& end) {
+    fileguard guard(fileslock);
+    fileinfo& fi = files[f];
+    if (!fi.loaded) {
+        std::ifstream ifs(fi.name, std::ifstream::in | std::ifstream::binary);
+        fi.loaded = fi.complete = ifs.is_open();
+        if (fi.loaded)
+            fi.buf.assign(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+    }
+    if (!fi.loaded)
+        return false;
+    begin = fi.text ? fi.text : fi.buf.data();
+    end = begin + (fi.text ? fi.size : fi.buf.size());
+    return true;
+}
+
+
+bool SourcePos::source(const char*& begin, const char*& end) const {
+    return source(File, begin, end);
+}
+
+
+/** Returns the line starts of a file. A lone '\r' or a "\r\n" pair end a
+ *  line, as in iposstream::get.
+ *
+ * @author Diesel
+ */
+const std::vector<int>& SourcePos::lineStarts(int f) {
+    fileguard guard(fileslock);
+    fileinfo& fi = files[f];
+    const char* b;
+    const char* e;
+    if (source(f, b, e)) {
+        size_t n = e - b;
+        for (; fi.counted < n; fi.counted++) {
+            char c = b[fi.counted];
+            if (c == '\r') {
+                if (fi.counted + 1 == n && !fi.complete)
+                    break;  // don't know yet if it's followed by '\n'
+                if (fi.counted + 1 == n || b[fi.counted + 1] != '\n')
+                    fi.lines.push_back(fi.counted + 2);
+            }
+            else if (c == '\n')
+                fi.lines.push_back(fi.counted + 2);
+        }
+    }
+    return fi.lines;
+}
+
+
+/** Returns the absolute position of the first character of the line.
+ *
+ * @author Diesel
+ */
+int SourcePos::lineStart() const {
+    if (Abs == 0)
+        return 0;
+    if (File == 0)
+        return 1;
+    fileguard guard(fileslock);
+    const std::vector<int>& l = lineStarts(File);
+    return *(std::upper_bound(l.begin(), l.end(), Abs) - 1);
+}
+
+
+/** Returns the line number.
+ *
+ * @author Diesel
+ */
+int SourcePos::line() const {
+    if (Abs == 0)
+        return 0;
+    if (File == 0)
+        return 1;
+    fileguard guard(fileslock);
+    const std::vector<int>& l = lineStarts(File);
+    return std::upper_bound(l.begin(), l.end(), Abs) - l.begin();
+}
+
+
+/** Returns the character column.
+ *
+ * @author Diesel
+ */
+int SourcePos::column() const {
+    if (Abs == 0)
+        return 0;
+    return Abs - lineStart() + 1;
+}
+
+
+/** Caches the source of a file from a buffer.
+ *
+ * @author Diesel
+ */
+void SourcePos::setSource(std::string f, const char* begin, const char* end,
+        std::shared_ptr<const void> owner) {
+    fileguard guard(fileslock);
+    fileinfo& fi = files[getFile(f)];
+    fi.owner = owner;
+    fi.text = begin;
+    fi.size = end - begin;
+    fi.buf.clear();
+    fi.loaded = fi.complete = true;
+    fi.lines.assign(1, 1);
+    fi.counted = 0;
+}
+
+
+/** Releases the buffer cached by setSource. The text is copied first, so
+ *  that positions already handed out keep their lines and quote what was
+ *  scanned, even if the file has since changed on disk.
  *
  * @author Diesel
  */
-std::set<std::string>::const_iterator SourcePos::getFile(std::string f) {
-    return fileNames.insert(f).first;
+void SourcePos::releaseSource(std::string f, const void* owner) {
+    fileguard guard(fileslock);
+    fileinfo& fi = files[getFile(f)];
+    if (!fi.text || fi.owner.get() != owner)
+        return;
+    fi.buf.assign(fi.text, fi.size);
+    fi.owner.reset();
+    fi.text = NULL;
+    fi.size = 0;
+}
+
+
+/** Starts caching the source of the file as it is read from a stream.
+ *
+ * @author Diesel
+ */
+void SourcePos::startSource() const {
+    fileguard guard(fileslock);
+    fileinfo& fi = files[File];
+    fi.owner.reset();
+    fi.text = NULL;
+    fi.buf.clear();
+    fi.loaded = true;
+    fi.complete = false;
+    fi.lines.assign(1, 1);
+    fi.counted = 0;
+}
+
+void SourcePos::addSource(char c) const {
+    fileguard guard(fileslock);
+    files[File].buf.push_back(c);
+}
+
+void SourcePos::endSource() const {
+    fileguard guard(fileslock);
+    files[File].complete = true;
 }
 
 
@@ -66,5 +230,5 @@ std::set<std::string>::const_iterator SourcePos::getFile(std::string f) {
  * @author Diesel
  */
 std::ostream& operator<<( std::ostream& os, const SourcePos& sp ) {
-    return( os << sp.Line << ":" << sp.Column );
+    return( os << sp.line() << ":" << sp.column() );
 }
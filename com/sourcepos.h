@@ -1,37 +1,85 @@
 
 #include <ostream>
 #include <string>
-#include <set>
+#include <vector>
+#include <deque>
+#include <memory>
 
 #ifndef GF2_SOURCEPOS_H
 #define GF2_SOURCEPOS_H
 
 
 /** A character position within a source file.
+ *
+ *  Only the file and the offset into it are stored, and the line and column
+ *  are looked up in a table of the line starts of the file when they are
+ *  needed, e.g. to report an error.
+ *
+ *  The text of each file is cached, so that errors can quote it without
+ *  reading the file again. Scanners give the cache the buffer they scan,
+ *  or the characters they read from a stream, see setSource and startSource,
+ *  otherwise the file is read the first time it is needed. A buffer is
+ *  released with releaseSource once its scanner is done with it, keeping a
+ *  copy of its text, so that the file is never read again behind the back
+ *  of the positions within it.
+ *
+ *  Positions without a file are within a single line of text, such as a
+ *  command typed by the user, so their column is their offset.
+ *
+ *  The file table is shared by every thread, e.g. one of a batch reporting
+ *  a runtime error, so it is locked while it is looked up or changed. Its
+ *  entries stay where they are as files are added.
  *
  * @author Diesel
  */
 struct SourcePos {
 private:
-    static std::set<std::string> fileNames;
+    /** A source file, its text and the positions of its lines
+     */
+    struct fileinfo {
+        std::string name;
+        std::shared_ptr<const void> owner;  // keeps text alive
+        const char* text;        // the source, if held elsewhere, or NULL
+        size_t size;
+        std::string buf;         // the source, if read by us or from a stream
+        bool loaded;             // the source is in text or buf, or being read
+        bool complete;           // all of the source has been read
+        std::vector<int> lines;  // Abs of the first character of each line
+        size_t counted;          // characters of source whose line ends are in lines
+    };
+    static std::deque<fileinfo> files;
 
-    /** Returns an iterator the the file name within the set
+    /** Returns the index of a file in the file table, adding it if needed.
      *  This allows string sharing between SourcePos instances.
      *
      * @param[in]  f    The string file name.
      *
-     * @return     The iterator to the file name in the table.
+     * @return     The index of the file in the table.
+     */
+    static int getFile(std::string f);
+
+    /** Returns the source of a file, reading the file if it isn't cached.
+     *
+     * @param[in]  f      The index of the file in the table.
+     * @param      begin  Returns the first character of the source.
+     * @param      end    Returns one past the last character read so far.
+     * @return     False if the file couldn't be read.
      */
-    std::set<std::string>::const_iterator getFile(std::string f);
+    static bool source(int f, const char*& begin, const char*& end);
+
+    /** Returns the line starts of a file, finding any in the source read
+     *  since they were last looked up.
+     *
+     * @param[in]  f     The index of the file in the table.
+     * @return     The Abs of the first character of each line.
+     */
+    static const std::vector<int>& lineStarts(int f);
 
 public:
-    /// The file name
-    std::set<std::string>::const_iterator File;
-    /// The line number
-	int Line;
-    /// The character column
-	int Column;
-    /// The absolute character position within the file.
+    /// The index of the file name in the file table, 0 if there is no file
+    int File;
+    /// The absolute character position within the file, counting from 1, or
+    /// 0 for the file as a whole.
 	int Abs;
 
     /** Return the string file name
@@ -46,12 +94,64 @@ public:
      */
     void setFile(std::string f);
 
+    /** Returns the line number, counting from 1.
+     *
+     * @return     The line of the position, or 0 if Abs is 0.
+     */
+    int line() const;
+
+    /** Returns the character column, counting from 1.
+     *
+     * @return     The column of the position, or 0 if Abs is 0.
+     */
+    int column() const;
+
+    /** Returns the absolute position of the first character of the line.
+     *
+     * @return     The Abs of the start of the line, or 0 if Abs is 0.
+     */
+    int lineStart() const;
+
+    /** Returns the cached source of the file, reading it if needed.
+     *
+     * @param      begin  Returns the first character of the source.
+     * @param      end    Returns one past the last character read so far.
+     * @return     False if the file couldn't be read.
+     */
+    bool source(const char*& begin, const char*& end) const;
+
+    /** Caches the source of a file from a buffer, such as a mapped file or
+     *  the string given to a scanner.
+     *
+     * @param[in]  f      The string file name.
+     * @param[in]  begin  The first character of the source.
+     * @param[in]  end    One past the last character of the source.
+     * @param[in]  owner  Keeps the buffer alive while it is cached.
+     */
+    static void setSource(std::string f, const char* begin, const char* end,
+        std::shared_ptr<const void> owner);
+
+    /** Releases the buffer cached by setSource, if it is still that owned by
+     *  owner, replacing it with a copy of its text. The line starts already
+     *  found are kept, as the text is the same.
+     *
+     * @param[in]  f      The string file name.
+     * @param[in]  owner  The owner given to setSource.
+     */
+    static void releaseSource(std::string f, const void* owner);
+
+    /** Starts caching the source of the file as it is read from a stream,
+     *  for files which can only be read once, such as pipes. The characters
+     *  are added with addSource, and endSource is called at the end.
+     */
+    void startSource() const;
+    void addSource(char c) const;
+    void endSource() const;
+
     /** Creates and populates a new SourcePos struct instance.
      */
 	SourcePos();
-    SourcePos(int line, int col);
-    SourcePos(int line, int col, int abs);
-	SourcePos( std::string file, int line, int col, int abs);
+	SourcePos( std::string file, int abs = 0 );
 
     /** Streams a source position to an output stream.
      *
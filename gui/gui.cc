@@ -3,6 +3,7 @@
 #include <algorithm>
 #include <iostream>
 #include <wx/filedlg.h>
+#include <wx/numdlg.h>
 
 #include "../lang/scanner.h"
 #include "../lang/parser.h"
@@ -40,6 +41,12 @@ BEGIN_EVENT_TABLE(MyFrame, wxFrame)
     EVT_MENU(GREEN_ID, MyFrame::OnColourGreen)
     EVT_MENU(BW_ID, MyFrame::OnColourBW)
     EVT_MENU(PINK_ID, MyFrame::OnColourPink)
+    // settling
+    EVT_MENU(MY_SETTLE_LIMIT_ID, MyFrame::OnSettleLimit)
+    EVT_MENU(MY_ABORT_ID, MyFrame::OnSettlePolicy)
+    EVT_MENU(MY_INDET_ID, MyFrame::OnSettlePolicy)
+    EVT_MENU(MY_CONTINUE_ID, MyFrame::OnSettlePolicy)
+    EVT_MENU(MY_PERIODIC_ID, MyFrame::OnPeriodic)
 
     // monitor manipulation
     EVT_BUTTON(wxID_ADD, MyFrame::OnAddMonitor)
@@ -88,10 +95,21 @@ MyFrame::MyFrame(wxWindow *parent, const wxPoint& pos, const wxSize& size, long
     viewMenu->Append(wxID_ZOOM_OUT, _("&Zoom out\tCtrl+-"));
     viewMenu->Append(MY_ZOOM_RESET_ID, _("&Reset zoom\tCtrl+0"));
 
+    // simulation menu
+    wxMenu *simMenu = new wxMenu;
+    simMenu->Append(MY_SETTLE_LIMIT_ID, _("Settle &limit..."));
+    simMenu->AppendSeparator();
+    simMenu->AppendRadioItem(MY_ABORT_ID, _("Stop when a cycle does not settle"));
+    simMenu->AppendRadioItem(MY_INDET_ID, _("Set outputs still changing to indet"));
+    simMenu->AppendRadioItem(MY_CONTINUE_ID, _("Continue when a cycle does not settle"));
+    simMenu->AppendSeparator();
+    simMenu->AppendCheckItem(MY_PERIODIC_ID, _("Count loops as settled"));
+
     // top level menu
     wxMenuBar *menuBar = new wxMenuBar;
     menuBar->Append(fileMenu, _("&File"));
     menuBar->Append(viewMenu, _("&View"));
+    menuBar->Append(simMenu, _("&Simulation"));
     SetMenuBar(menuBar);
 
     // top level sizer
@@ -328,6 +346,7 @@ void MyFrame::OnRunButton(wxCommandEvent &event)
         // reset the network, start from scratch
     dmz->resetdevices();
     mmz->resetmonitor();
+    cyclescompleted = 0;
     int spinValue = spin->GetValue();
     if (runnetwork(spinValue)) {
         canvas->resetCycles();
@@ -411,20 +430,65 @@ bool MyFrame::runnetwork(int ncycles)
     // Function to run the network, derived from corresponding function in userint.cc
 {
     bool ok = true;
-    int n = ncycles;
+    int n = ncycles, idle;
+    std::vector<int> unsettled;             // cycles carried on past without settling
 
     while ((n > 0) && ok) {
+        idle = dmz->skipidle (n);
+        if (idle > 0) {
+            n -= idle;
+            mmz->recordsignals (idle);
+            continue;
+        }
         dmz->executedevices (ok);
+        int cycle = cyclescompleted + ncycles - n + 1;
         if (ok) {
+            cycleresult r = dmz->lastcycle();
+            if (r == oscillatingcycle || r == limitcycle)
+                unsettled.push_back(cycle);
             n--;
             mmz->recordsignals ();
         } else {
-            wxMessageDialog err(this, "Network is oscillating.\n\nCheck your circuit doesn't have any contradictory circuit paths, like an inverter with the output connected to the input.",
+            // list the devices found going round the loop, where known
+            std::vector<devlink> devs;
+            std::ostringstream where;
+            dmz->oscillating(devs);
+            if (!devs.empty())
+                where << "\n\nThese devices keep changing, and never settle:";
+            for (unsigned int k = 0; k < devs.size() && k < 10; k++)
+                where << "\n    " << nmz->namestr(devs[k]->id) << " (line " << devs[k]->definedAt.line() << ")";
+            if (devs.size() > 10)
+                where << "\n    ...";
+
+            std::ostringstream what;
+            if (dmz->lastcycle() == oscillatingcycle)
+                what << "Network is oscillating on cycle " << cycle << ".";
+            else
+                what << "Network did not settle within " << settle.limit << " machine cycles on cycle " << cycle << ".";
+
+            wxMessageDialog err(this, what.str() + "\n\nCheck your circuit doesn't have any contradictory circuit paths, like an inverter with the output connected to the input." + where.str(),
                 "An error occurred during simulation", wxICON_ERROR | wxOK);
             err.ShowModal();
         }
     }
-    if (!ok) mmz->resetmonitor();
+    if (!unsettled.empty()) {
+        // one warning for the whole run, listing the first few cycles
+        std::ostringstream what;
+        what << unsettled.size() << " cycles did not settle within " << settle.limit << " machine cycles";
+        if (settle.policy == indetpolicy)
+            what << ", and the outputs still changing were set to indet";
+        what << ":\n\n    cycle";
+        for (unsigned int k = 0; k < unsettled.size() && k < 10; k++)
+            what << (k ? ", " : " ") << unsettled[k];
+        if (unsettled.size() > 10)
+            what << ", ...";
+        wxMessageDialog warn(this, what.str(), "Simulation warning", wxICON_WARNING | wxOK);
+        warn.ShowModal();
+    }
+    if (ok)
+        cyclescompleted += ncycles;
+    else
+        mmz->resetmonitor();
     return ok;
 }
 
@@ -437,7 +501,8 @@ void MyFrame::initNetwork() {
     nmz = new names();
     netz = new network(nmz);
     dmz = new devices(nmz, netz);
-    mmz = new monitor(nmz, netz);
+    dmz->setsettle(settle);
+    mmz = new monitor(nmz, netz, dmz);
 
     hasNetwork = true;
     fileOpen = false;
@@ -588,4 +653,35 @@ void MyFrame::OnColourBW(wxCommandEvent &event) {
 
 void MyFrame::OnColourPink(wxCommandEvent &event) {
     colourChange(3);
-}
\ No newline at end of file
+}
+
+
+void MyFrame::OnSettleLimit(wxCommandEvent &event)
+    // Event handler for the Simulation->Settle limit menu item
+{
+    long n = wxGetNumberFromUser(_("The most machine cycles each cycle may take to settle."),
+                                 _("Machine cycles:"), _("Settle limit"),
+                                 settle.limit, 1, maxsettlelimit, this);
+    if (n < 1) return;
+    settle.limit = n;
+    if (hasNetwork) dmz->setsettle(settle);
+}
+
+void MyFrame::OnSettlePolicy(wxCommandEvent &event)
+    // Event handler for the radio items choosing what is done with a cycle which does not settle
+{
+    if (event.GetId() == MY_INDET_ID)
+        settle.policy = indetpolicy;
+    else if (event.GetId() == MY_CONTINUE_ID)
+        settle.policy = continuepolicy;
+    else
+        settle.policy = abortpolicy;
+    if (hasNetwork) dmz->setsettle(settle);
+}
+
+void MyFrame::OnPeriodic(wxCommandEvent &event)
+    // Event handler for Simulation->Count loops as settled
+{
+    settle.criterion = event.IsChecked() ? periodicconverge : steadyconverge;
+    if (hasNetwork) dmz->setsettle(settle);
+}
@@ -32,7 +32,12 @@ enum {
   BLUE_ID,
   GREEN_ID,
   BW_ID,
-  PINK_ID
+  PINK_ID,
+  MY_SETTLE_LIMIT_ID,
+  MY_ABORT_ID,
+  MY_INDET_ID,
+  MY_CONTINUE_ID,
+  MY_PERIODIC_ID
 }; // widget identifiers
 
 class MyFrame: public wxFrame
@@ -58,6 +63,7 @@ class MyFrame: public wxFrame
   monitor *mmz;                           // pointer to monitor class
   network *netz;
   int cyclescompleted;                    // how many simulation cycles have been completed
+  settleoptions settle;                   // how each cycle settles, kept when files are opened
   bool hasNetwork;
   bool fileOpen;
   wxString fname;
@@ -94,6 +100,10 @@ class MyFrame: public wxFrame
 
   void toggleButtonsEnabled(bool enabled);
 
+  void OnSettleLimit(wxCommandEvent& event);     // event handler for the settle limit menu item
+  void OnSettlePolicy(wxCommandEvent& event);    // event handler for the unsettled cycle radio items
+  void OnPeriodic(wxCommandEvent& event);        // event handler for counting loops as settled
+
   void colourChange(int index);
   void OnColourBlue(wxCommandEvent& event);
   void OnColourGreen(wxCommandEvent& event);
@@ -7,6 +7,22 @@
 
 #include "../sim/monitor.h"
 #include "../com/names.h"
+#include "wavetrace.h"
+
+
+// vertex buffers holding one level of a wavetrace
+struct wavebuffer {
+  GLuint id[wavearrays] = {0, 0, 0};        // buffer names, 0 until first uploaded
+  size_t capacity[wavearrays] = {0, 0, 0};  // floats allocated in each buffer
+};
+
+// decimated copy of one monitor's history, see MyGLCanvas::syncWaves
+struct monitorwave {
+  name dev = blankname;                     // the monitor point copied
+  name pin = blankname;
+  wavetrace trace;
+  std::vector<wavebuffer> buffers;          // for each level of trace drawn
+};
 
 
 class MyGLCanvas: public wxGLCanvas
@@ -50,11 +66,17 @@ void setNetwork(monitor* mmz, names* nmz);
   int end_gap;                       // dist between end and side
   bool on_title;                     // stores whether system state is on title screen
   bool zoom_changed;                 // stores whether the zoom has been changed since previous Render
+  std::vector<monitorwave> waves;    // copy of each monitor's history, drawn from vertex buffers
 
   void drawText(wxString text, int pos_x, int pos_y, void* font, int line_spacing = 18);
   void titleScreen(wxString message_text);
   void setLineColour(float RGB[3]);
   void drawPlot(asignal s, int plot_num, int mon_num, int zoomrange[2], int cycle_no, int cyclesdisplayed, int num_spacing);
+  void drawTrace(monitorwave& wave, int y);
+  void syncWaves();
+  void clearWave(monitorwave& wave, int start);
+  void clearWaves();
+  void uploadWave(GLuint& id, size_t& capacity, const std::vector<float>& v, size_t from);
 
 
   void InitGL();                     // function to initialise OpenGL context
@@ -0,0 +1,303 @@
+#include <algorithm>
+
+#include "wavetrace.h"
+
+
+// signal levels seen in a bucket, as a mask
+static const unsigned char wavelow = 1;
+static const unsigned char wavehigh = 2;
+static const unsigned char waveindet = 4;
+
+static const int maxwavelevel = 30;
+
+
+/** Returns the mask of a signal level, drawing edges as the level they reach
+ *  and floating inputs as indet.
+ */
+static unsigned char signalmask (asignal s)
+{
+  switch (s) {
+    case low:
+    case falling:
+      return wavelow;
+    case high:
+    case rising:
+      return wavehigh;
+    default:
+      return waveindet;
+  }
+}
+
+
+/** Returns the lowest and highest y of the levels in a mask.
+ */
+static float masklow (unsigned char m)
+{
+  return (m & wavelow) ? 0 : (m & waveindet) ? 1 : 2;
+}
+
+static float maskhigh (unsigned char m)
+{
+  return (m & wavehigh) ? 2 : (m & waveindet) ? 1 : 0;
+}
+
+
+/** Adds a vertex to an array.
+ */
+static void vertex (std::vector<float>& v, float x, float y)
+{
+  v.push_back (x);
+  v.push_back (y);
+}
+
+
+/** Finds the vertices of one array which may be visible between two cycles,
+ *  using the x of the first two vertices of each primitive, which never
+ *  decrease along the array.
+ *
+ * @author Diesel
+ */
+void wavelevel::span (wavearray a, float x0, float x1, int& first, int& n) const
+{
+  const std::vector<float>& v = verts[a];
+  int per = (a == wavebands) ? 4 : 2;     // vertices per primitive
+  int stride = 2 * per;
+  int lo = 0, hi = v.size () / stride, mid;
+
+  // first primitive ending at or after x0
+  while (lo < hi) {
+    mid = (lo + hi) / 2;
+    if (v[mid * stride + 2] < x0)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  first = lo;
+
+  // first primitive starting after x1
+  hi = v.size () / stride;
+  while (lo < hi) {
+    mid = (lo + hi) / 2;
+    if (v[mid * stride] <= x1)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  n = (lo - first) * per;
+  first *= per;
+}
+
+
+/** Marks every vertex as uploaded.
+ *
+ * @author Diesel
+ */
+void wavelevel::uploaded (void)
+{
+  for (int a = 0; a < wavearrays; a++)
+    changed[a] = verts[a].size ();
+}
+
+
+/** Initialises an empty level.
+ *
+ * @author Diesel
+ */
+wavelevel::wavelevel ()
+{
+  for (int a = 0; a < wavearrays; a++) {
+    done[a] = 0;
+    changed[a] = 0;
+  }
+  runstart = 0;
+  scanned = 0;
+  prevmask = 0;
+}
+
+
+/** Brings the masks of a level up to date with the cycles held, merging pairs
+ *  of buckets from the level below. The last bucket may have been partly
+ *  filled before, so is merged again.
+ *
+ * @author Diesel
+ */
+void wavetrace::fillmasks (int k)
+{
+  if (k == 0)
+    return;
+  fillmasks (k - 1);
+  const std::vector<unsigned char>& below = levels[k - 1].mask;
+  std::vector<unsigned char>& mask = levels[k].mask;
+  int n = (below.size () + 1) / 2;
+  int b = mask.empty () ? 0 : mask.size () - 1;
+
+  mask.resize (n);
+  for (; b < n; b++) {
+    unsigned int i = 2 * b;
+    mask[b] = below[i] | ((i + 1 < below.size ()) ? below[i + 1] : 0);
+  }
+}
+
+
+/** Adds the vertices of a run of buckets with the same mask: a horizontal
+ *  line for a single level, dotted for indet, or a band between the lowest
+ *  and highest levels seen. Between two runs of low and high, the edge is
+ *  drawn too.
+ *
+ * @author Diesel
+ */
+void wavetrace::emitrun (wavelevel& lv, unsigned char prev, int b0, int b1, int k)
+{
+  unsigned char m = lv.mask[b0];
+  float x0 = first + ((long long) b0 << k);
+  float x1 = first + std::min<long long> ((long long) b1 << k, count);
+  float y0 = masklow (m), y1 = maskhigh (m);
+  bool single = (y0 == y1);
+
+  if (single && m != waveindet && (prev == wavelow || prev == wavehigh) && prev != m) {
+    vertex (lv.verts[wavelines], x0, masklow (prev));
+    vertex (lv.verts[wavelines], x0, y0);
+  }
+  if (single) {
+    std::vector<float>& v = lv.verts[(m == waveindet) ? wavedots : wavelines];
+    vertex (v, x0, y0);
+    vertex (v, x1, y0);
+  } else {
+    std::vector<float>& v = lv.verts[wavebands];
+    vertex (v, x0, y0);
+    vertex (v, x1, y0);
+    vertex (v, x1, y1);
+    vertex (v, x0, y1);
+  }
+}
+
+
+/** Brings the vertices of a level up to date with its masks. Runs closed by a
+ *  complete bucket with a different mask are kept, and the run still open is
+ *  drawn again up to the last cycle held.
+ *
+ * @author Diesel
+ */
+void wavetrace::update (wavelevel& lv, int k)
+{
+  int n = lv.mask.size ();
+  int complete = count >> k;      // buckets which will not change
+  int b, a;
+
+  for (a = 0; a < wavearrays; a++) {
+    lv.verts[a].resize (lv.done[a]);
+    lv.changed[a] = std::min (lv.changed[a], lv.done[a]);
+  }
+
+  for (b = std::max (lv.scanned, lv.runstart + 1); b < complete; b++) {
+    if (lv.mask[b] != lv.mask[lv.runstart]) {
+      emitrun (lv, lv.prevmask, lv.runstart, b, k);
+      lv.prevmask = lv.mask[lv.runstart];
+      lv.runstart = b;
+      for (a = 0; a < wavearrays; a++)
+        lv.done[a] = lv.verts[a].size ();
+    }
+  }
+  lv.scanned = std::max (lv.scanned, complete);
+
+  if (lv.runstart >= n)
+    return;
+  if (lv.runstart < complete && complete < n && lv.mask[complete] != lv.mask[lv.runstart]) {
+    // the last bucket, partly filled, does not continue the open run
+    emitrun (lv, lv.prevmask, lv.runstart, complete, k);
+    emitrun (lv, lv.mask[lv.runstart], complete, n, k);
+  } else
+    emitrun (lv, lv.prevmask, lv.runstart, n, k);
+}
+
+
+/** Adds the next cycle.
+ *
+ * @author Diesel
+ */
+void wavetrace::push (asignal s)
+{
+  levels[0].mask.push_back (signalmask (s));
+  count++;
+}
+
+
+/** Removes every cycle.
+ *
+ * @author Diesel
+ */
+void wavetrace::clear (int start)
+{
+  levels.assign (1, wavelevel ());
+  first = start;
+  count = 0;
+}
+
+
+/** Returns the number of the first cycle held.
+ *
+ * @author Diesel
+ */
+int wavetrace::start (void) const
+{
+  return first;
+}
+
+
+/** Returns the number of the cycle after the last held.
+ *
+ * @author Diesel
+ */
+int wavetrace::end (void) const
+{
+  return first + count;
+}
+
+
+/** Returns the number of cycles held.
+ *
+ * @author Diesel
+ */
+int wavetrace::size (void) const
+{
+  return count;
+}
+
+
+/** Chooses the level to draw at, the highest with buckets of no more cycles
+ *  than a pixel column shows, so at most two buckets share a column.
+ *
+ * @author Diesel
+ */
+int wavetrace::pick (double cyclesperpixel)
+{
+  int k = 0;
+  while (k < maxwavelevel && (double) (2LL << k) <= cyclesperpixel)
+    k++;
+  return k;
+}
+
+
+/** Returns a level, bringing its vertices up to date with the cycles held.
+ *
+ * @author Diesel
+ */
+wavelevel& wavetrace::level (int k)
+{
+  k = std::max (0, std::min (k, maxwavelevel));
+  if ((int) levels.size () <= k)
+    levels.resize (k + 1);
+  fillmasks (k);
+  update (levels[k], k);
+  return levels[k];
+}
+
+
+/** Initialises an empty trace.
+ *
+ * @author Diesel
+ */
+wavetrace::wavetrace (int start)
+{
+  clear (start);
+}
@@ -0,0 +1,132 @@
+#ifndef GF2_WAVETRACE_H
+#define GF2_WAVETRACE_H
+
+#include <vector>
+#include <cstddef>
+
+#include "../sim/network.h"
+
+
+/** The arrays of vertices in each level of a wavetrace, each drawn as its own
+ *  OpenGL primitive.
+ *
+ *  wavelines  GL_LINES, steps of low and high, including the edges between
+ *  wavedots   GL_LINES, runs of indet, drawn stippled
+ *  wavebands  GL_QUADS, runs where the signal took more than one level
+ */
+typedef enum {wavelines, wavedots, wavebands, wavearrays} wavearray;
+
+
+/** One level of a wavetrace, holding the trace in buckets of 2^k cycles.
+ *
+ *  Consecutive buckets with the same mask are drawn as one run, so vertices
+ *  follow the changes of the signal rather than the cycles. Only the last run
+ *  changes when cycles are added, so only the vertices from done onwards are
+ *  replaced.
+ *
+ *  Vertices are x, y pairs, x in cycles and y from 0 for low to 2 for high.
+ *  Primitives are in order of x, see span.
+ *
+ * @author Diesel
+ */
+struct wavelevel {
+  std::vector<unsigned char> mask;        // levels the signal took in each bucket
+  std::vector<float> verts[wavearrays];   // the vertices, two floats each
+  size_t done[wavearrays];                // floats of runs which will not change
+  size_t changed[wavearrays];             // first float changed since marked uploaded
+  int runstart;                           // first bucket of the run still open
+  int scanned;                            // buckets compared with the open run
+  unsigned char prevmask;                 // mask of the run before, or 0
+
+  /** Finds the vertices of one array which may be visible between two cycles.
+   *
+   * @param[in]  a      The array.
+   * @param[in]  x0     The first cycle on screen.
+   * @param[in]  x1     The last cycle on screen.
+   * @param      first  Returns the first vertex.
+   * @param      n      Returns the number of vertices.
+   */
+  void span (wavearray a, float x0, float x1, int& first, int& n) const;
+
+  /** Marks every vertex as uploaded, so changed is the end of each array.
+   */
+  void uploaded (void);
+
+  /** Initialises an empty level.
+   */
+  wavelevel ();
+};
+
+
+/** Copy of a monitor's history for drawing, as a pyramid of levels of detail.
+ *  Level 0 has a bucket for each cycle, and each level above merges pairs of
+ *  buckets of the level below, keeping the set of signal levels seen, so a
+ *  bucket holds the minimum and maximum of the signal over its cycles.
+ *
+ *  Drawing at a level whose buckets are about a pixel wide needs at most a
+ *  few vertices for each pixel column, however many cycles are on screen.
+ *  Levels are only filled, and their vertices made, when first drawn, then
+ *  kept up to date as cycles are added.
+ *
+ *  Cycles are numbered from the first cycle run, not from the start of the
+ *  monitor history, so adding cycles never moves those already held.
+ *
+ * @author Diesel
+ */
+class wavetrace {
+  std::vector<wavelevel> levels;
+  int first;          // cycle held in bucket 0 of every level
+  int count;          // number of cycles held
+
+  void fillmasks (int k);
+  void update (wavelevel& lv, int k);
+  void emitrun (wavelevel& lv, unsigned char prev, int b0, int b1, int k);
+
+ public:
+  /** Adds the next cycle.
+   *
+   * @param[in]  s     The signal level in the cycle.
+   */
+  void push (asignal s);
+
+  /** Removes every cycle.
+   *
+   * @param[in]  start  The cycle number of the next cycle pushed.
+   */
+  void clear (int start);
+
+  /** Returns the number of the first cycle held.
+   */
+  int start (void) const;
+
+  /** Returns the number of the cycle after the last held.
+   */
+  int end (void) const;
+
+  /** Returns the number of cycles held.
+   */
+  int size (void) const;
+
+  /** Chooses the level to draw at, with buckets up to a pixel wide.
+   *
+   * @param[in]  cyclesperpixel  The cycles on screen for each pixel column.
+   * @return     The level.
+   */
+  static int pick (double cyclesperpixel);
+
+  /** Returns a level, bringing its vertices up to date with the cycles held.
+   *
+   * @param[in]  k     The level, from 0.
+   * @return     The level.
+   */
+  wavelevel& level (int k);
+
+  /** Initialises an empty trace.
+   *
+   * @param[in]  start  The cycle number of the first cycle pushed.
+   */
+  wavetrace (int start = 0);
+};
+
+
+#endif /* GF2_WAVETRACE_H */
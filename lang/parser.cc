@@ -46,8 +46,10 @@ bool parser::readin() {
 
        _netz->checknetwork(errs);
 
-       if (errs.errCount() == 0)
+       if (errs.errCount() == 0) {
+        _devz->compile();
         _devz->resetdevices();
+       }
     }
     catch (matterror& e) {
         errs.report(e);
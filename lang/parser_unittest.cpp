@@ -142,7 +142,7 @@ protected:
         nmz = new names();
         netz = new network(nmz);
         dmz = new devices(nmz, netz);
-        mmz = new monitor(nmz, netz);
+        mmz = new monitor(nmz, netz, dmz);
         smz = new scanner(nmz);
         nwb = new networkbuilder(netz, dmz, mmz, nmz, errs);
         psr = new parser(netz, dmz, mmz, smz, nmz);
@@ -164,6 +164,9 @@ public:
         actionstaken.push_back(ac);
     }
     static Token getNextToken() {
+        // the stream ends with EndOfFile, which is repeated if read past
+        if (_iter + 1 == _tkstream.end())
+            return *_iter;
         Token ret = *_iter;
         _iter++;
         return ret;
@@ -223,21 +226,24 @@ void networkbuilder::defineMonitor(Signal& monSig, Signal& aliSig) {
     ParserTest::pushAction(ac);
 }
 
+void networkbuilder::importDevice(Token& devName, Token& fileStr) {
+}
+
 // Todo: move token to another file
 Token::Token()
-    : type(TokType::EndOfFile) {}
+    : type(TokType::EndOfFile), id(blankname) {}
 
 Token::Token(SourcePos pos, TokType t)
-    : at(pos), type(t) {}
+    : at(pos), type(t), id(blankname) {}
 
 Token::Token(TokType t)
-    : at(), type(t) {}
+    : at(), type(t), id(blankname) {}
 
 Token::Token(TokType t, name s)
     : at(), type(t), id(s) {}
 
 Token::Token(TokType t, int num)
-    : at(), type(t), number(num) {
+    : at(), type(t), id(blankname), number(num) {
     if (t == TokType::DeviceType) {
         devtype = devicekind(num);
     }
@@ -250,6 +256,11 @@ scanner::scanner(names* nmz) {}
 scanner::~scanner(){}
 bool scanner::open(std::istream* is, std::string fname) {return true;}
 std::string scanner::getFile() const {return "";}
+scanner* scanner::getParent() {return NULL;}
+void scanner::setParent(scanner* p) {}
+fscanner::fscanner(names* nmz) : scanner(nmz) {}
+fscanner::~fscanner() {}
+bool fscanner::open(std::string fname) {return false;}
 Token scanner::step() {
     Token ret = _next;
     _next = readNext();
@@ -6,6 +6,11 @@
 #include <string>
 #include <vector>
 
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
 #include "../com/names.h"
 #include "../com/iposstream.h"
 #include "../com/errorhandler.h"
@@ -37,17 +42,17 @@ const std::map<namestring, devicekind> deviceTypes = {
  * @author Diesel
  */
 Token::Token()
-    : type(TokType::EndOfFile)
+    : type(TokType::EndOfFile), id(blankname)
 {
 }
 
 Token::Token(SourcePos pos, TokType t)
-    : at(pos), type(t)
+    : at(pos), type(t), id(blankname)
 {
 }
 
 Token::Token(TokType t)
-    : at(), type(t) {
+    : at(), type(t), id(blankname) {
 }
 
 Token::Token(TokType t, name s)
@@ -55,7 +60,7 @@ Token::Token(TokType t, name s)
 }
 
 Token::Token(TokType t, int num)
-    : at(), type(t), number(num) {
+    : at(), type(t), id(blankname), number(num) {
     if (t == TokType::DeviceType) {
         devtype = devicekind(num);
     }
@@ -109,14 +114,14 @@ Token scanner::readNext() {
     }
 
     if (_ips.eof()) {
-        ret.at = _ips.Pos;
+        ret.at = _ips.pos();
         _hasNext = true;
         return ret;
     }
 
     // Check for comment
     if (c == '/') {
-        SourcePos p = _ips.Pos;
+        SourcePos p = _ips.pos();
         c = readChar();
 
         if (c == '/') {
@@ -146,7 +151,7 @@ Token scanner::readNext() {
         }
 
         if (_ips.eof()) {
-            ret.at = _ips.Pos;
+            ret.at = _ips.pos();
             _hasNext = true;
             return ret;
         }
@@ -154,7 +159,7 @@ Token scanner::readNext() {
         return readNext();
     }
 
-    ret.at = _ips.Pos;
+    ret.at = _ips.pos();
 
     // Conveniently, the scanner is also single lookahead.
     switch (c) {
@@ -215,7 +220,7 @@ Token scanner::readNext() {
                     ret.type = TokType::ImportKeyword;
                 }
                 else { // Check for device types
-                    auto it = deviceTypes.find(*ret.id);
+                    auto it = deviceTypes.find(_nmz->namestr(ret.id));
                     if (it != deviceTypes.end()) {
                 	   ret.type = TokType::DeviceType;
                        ret.devtype = it->second;
@@ -256,6 +261,18 @@ Token scanner::readNext() {
  * @author Diesel
  */
 name scanner::readName(int c1) {
+    const char* end;
+    const char* p = _ips.buffer(end);
+    if (p) {
+        // Take the name straight from the buffer
+        const char* start = p - 1;
+        while (p != end && (std::isalnum((unsigned char) *p) || *p == '_')) {
+            p++;
+        }
+        _ips.extract(p);
+        return _nmz->lookup(start, p - start);
+    }
+
     std::basic_ostringstream<char, namestring::traits_type> oss;
     oss << char(c1);
 
@@ -304,7 +321,7 @@ int scanner::readNumber(int c1) {
 std::string scanner::readString(int c1) {
     std::ostringstream oss;
 
-    SourcePos start = _ips.Pos;
+    SourcePos start = _ips.pos();
 
     for (int c = _ips.get();;c = _ips.get()) {
 
@@ -337,7 +354,7 @@ std::string scanner::readString(int c1) {
 std::vector<bool> scanner::readBitstream(int c1) {
     std::vector<bool> ret;
 
-    SourcePos start = _ips.Pos;
+    SourcePos start = _ips.pos();
 
     while(_ips.peek() == '0' || _ips.peek() == '1') {
         ret.push_back(_ips.get() == '1');
@@ -393,6 +410,21 @@ bool scanner::open(std::istream* is, std::string fname) {
 }
 
 
+/** Scan a buffer in memory with the given file name.
+ *
+ * @author Diesel
+ */
+bool scanner::open(const char* begin, const char* end, std::string fname) {
+    _ips.setBuffer(begin, end, fname);
+    _file = fname;
+
+    _open = true;
+    _hasNext = false;
+
+    return _open;
+}
+
+
 /** Steps forwards in the stream to the next token.
  *
  * @author Diesel
@@ -438,18 +470,50 @@ fscanner::fscanner(names* nmz) : scanner(nmz) {
 
 
 /** Clears resources allocated by the file scanner.
+ *  The mapped file is dropped from the source cache and unmapped, so errors
+ *  quoting it afterwards read it again, see SourcePos.
  *
  * @author Diesel
  */
-fscanner::~fscanner() {}
+fscanner::~fscanner() {
+    if (_map)
+        SourcePos::releaseSource(_file, _map.get());
+}
 
 /** Opens a file, and then sets that as the base for the scanner.
+ *  Regular files are mapped into memory and scanned in place. Anything which
+ *  can't be mapped, such as a pipe, is read through a stream instead.
  *  Note: Streams should be opened as binary in order to prevent issues with
  *  changing EoL characters.
  *
  * @author Diesel
  */
 bool fscanner::open(std::string fname) {
+    int fd = ::open(fname.c_str(), O_RDONLY);
+    if (fd >= 0) {
+        struct stat st;
+        if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+            static const char empty[] = "";
+            if (st.st_size == 0) {
+                // mmap can't map an empty file
+                close(fd);
+                SourcePos::setSource(fname, empty, empty, NULL);
+                return scanner::open(empty, empty, fname);
+            }
+            size_t size = st.st_size;
+            void* m = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (m != MAP_FAILED) {
+                close(fd);
+                madvise(m, size, MADV_SEQUENTIAL);
+                _map.reset(static_cast<const char*>(m),
+                    [size](const char* p) { munmap((void*) p, size); });
+                SourcePos::setSource(fname, _map.get(), _map.get() + size, _map);
+                return scanner::open(_map.get(), _map.get() + size, fname);
+            }
+        }
+        close(fd);
+    }
+
     _ifs.open(fname, std::ifstream::in | std::ifstream::binary);
 
     return scanner::open(&_ifs, fname);
@@ -463,8 +527,9 @@ bool fscanner::open(std::string fname) {
  * @author Diesel
  */
 strscanner::strscanner(names* nmz, std::string str)
-        : scanner(nmz), _iss(std::ifstream::in | std::ifstream::binary) {
+        : scanner(nmz), _str(std::make_shared<const std::string>(str)) {
 
-    _iss.str(str);
-    scanner::open(&_iss, "");
+    const char* begin = _str->data();
+    SourcePos::setSource("", begin, begin + _str->size(), _str);
+    scanner::open(begin, begin + _str->size(), "");
 }
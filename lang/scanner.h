@@ -5,6 +5,7 @@
 #include <sstream>
 #include <map>
 #include <vector>
+#include <memory>
 
 #include "../com/iposstream.h" // SourcePos
 #include "../com/names.h" // names, namestring, name
@@ -151,6 +152,16 @@ public:
      */
     bool open(std::istream* is, std::string fname);
 
+    /** Open a buffer of characters in memory with the given file name. The
+     *  buffer is scanned in place, so must outlive the scanner.
+     *
+     * @param[in]  begin  The first character of the buffer
+     * @param[in]  end    One past the last character of the buffer
+     * @param[in]  fname  The file name for error reports.
+     * @return     True if the buffer was set as the base of the scanner.
+     */
+    bool open(const char* begin, const char* end, std::string fname);
+
     /** Steps forwards in the stream to the next token.
      *
      * @return     The next token in the input stream.
@@ -185,7 +196,7 @@ public:
 
 /** File scanner class.
  *  Simple extension to scanner class that opens a file and initialises the
- *  scanner based on that stream.
+ *  scanner based on it, mapping it into memory where possible.
  *
  *  @author Diesel
  */
@@ -193,6 +204,7 @@ class fscanner : public scanner
 {
 private:
     std::ifstream _ifs;
+    std::shared_ptr<const char> _map;  // the mapped file, or NULL if read from _ifs
 public:
     /** Initialises the file scanner
      *
@@ -214,15 +226,15 @@ public:
 
 
 /** String scanner class.
- *  Simple extension to scanner class that opens a string stream and initialises the
- *  scanner based on that stream.
+ *  Simple extension to scanner class that scans a copy of a string, which is
+ *  kept as the source for positions without a file.
  *
  *  @author Diesel
  */
 class strscanner : public scanner
 {
 private:
-    std::istringstream _iss;
+    std::shared_ptr<const std::string> _str;
 public:
     /** Creates the string scanner, and opens the string.
      *
@@ -20,6 +20,10 @@
 #include <string>
 #include <sstream>
 #include <ostream>
+#include <fstream>
+#include <vector>
+#include <cstdio>
+#include <thread>
 #include "../com/names.h"
 #include "../com/errorhandler.h"
 #include "../sim/network.h"
@@ -128,8 +132,8 @@ class ScannerTest : public ::testing::Test {
 
             if (tk.type == Identifier) {
                 EXPECT_EQ(stream[tn].id, tk.id) << "Itentifier name different at position " << tn
-                << ", expected " << *stream[tn].id
-                << " got " << *tk.id;
+                << ", expected " << nmz->namestr(stream[tn].id)
+                << " got " << nmz->namestr(tk.id);
             }
             else if (tk.type == Number) {
                 EXPECT_EQ(stream[tn].number, tk.number) << "Itentifier number different at position " << tn
@@ -433,3 +437,254 @@ TEST_F(ScannerTest, BigNumberToken){
 TEST_F(ScannerTest, NegativeNumberToken){
     testscannerError("-1234");
 }
+
+
+// NAMES
+// Returns a name's string with its capitalisation, as namestrings compare
+// ignoring case
+static std::string exactstr(const namestring& s) {
+    return std::string(s.data(), s.length());
+}
+
+// @author   Diesel
+TEST_F(ScannerTest, NamesIgnoreCase){
+    name id = nmz->lookup("Clock1");
+    EXPECT_NE(blankname, id);
+    EXPECT_EQ(id, nmz->lookup("CLOCK1"));
+    EXPECT_EQ(id, nmz->lookup("clock1"));
+    EXPECT_EQ(id, nmz->cvtname("cLoCk1"));
+    EXPECT_NE(id, nmz->lookup("Clock2"));
+}
+
+// @author   Diesel
+TEST_F(ScannerTest, NamesKeepFirstCapitalisation){
+    name id = nmz->lookup("SwItch1");
+    nmz->lookup("SWITCH1");
+    nmz->lookup("switch1");
+    EXPECT_EQ("SwItch1", exactstr(nmz->namestr(id)));
+    EXPECT_EQ(7, nmz->namelength(id));
+}
+
+// Ids count up from the size of the table and do not change as it grows
+// @author   Diesel
+TEST_F(ScannerTest, NamesDenseWhenTableGrows){
+    const int n = 1000;
+    size_t first = nmz->size();
+    for (int i = 0; i < n; i++) {
+        std::string s = "sig" + std::to_string(i);
+        EXPECT_EQ(first + i, (size_t) nmz->lookup(s.c_str(), s.length()));
+    }
+    EXPECT_EQ(first + n, nmz->size());
+
+    for (int i = 0; i < n; i++) {
+        std::string s = "SIG" + std::to_string(i);
+        name id = nmz->lookup(s.c_str(), s.length());
+        EXPECT_EQ(first + i, (size_t) id);
+        EXPECT_EQ("sig" + std::to_string(i), exactstr(nmz->namestr(id)));
+    }
+    EXPECT_EQ(first + n, nmz->size());
+}
+
+// @author   Diesel
+TEST_F(ScannerTest, NamesUnknownIsBlank){
+    size_t size = nmz->size();
+    EXPECT_EQ(blankname, nmz->cvtname("nosuchname"));
+    EXPECT_EQ(blankname, nmz->cvtname(""));
+    EXPECT_EQ(blankname, nmz->lookup(""));
+    EXPECT_EQ(size, nmz->size());
+    EXPECT_EQ(0, nmz->namelength(blankname));
+}
+
+
+// FILES AND POSITIONS
+// Writes a file in the temporary directory, returning its path
+static std::string writefile(std::string fname, std::string text) {
+    std::string path = ::testing::TempDir() + fname;
+    std::ofstream ofs(path.c_str(), std::ofstream::out | std::ofstream::binary);
+    ofs << text;
+    return path;
+}
+
+// Line and column of each character, counted as the stream was read before
+// positions were looked up from offsets: "\r\n" and a lone '\r' end a line,
+// and are read as one '\n' at the position of the '\r'. The '\n' of a "\r\n"
+// is never read by itself, so is given line 0.
+struct linecol {
+    int line, column;
+};
+
+static std::vector<linecol> streampositions(std::string text) {
+    std::vector<linecol> pos;
+    int line = 1, column = 1;
+    for (size_t i = 0; i < text.size(); i++) {
+        pos.push_back({line, column});
+        if (text[i] == '\r' || text[i] == '\n') {
+            if (text[i] == '\r' && i + 1 < text.size() && text[i + 1] == '\n') {
+                i++;
+                pos.push_back({0, 0});
+            }
+            line++;
+            column = 1;
+        }
+        else
+            column++;
+    }
+    return pos;
+}
+
+// Returns the types of the tokens in a file, and checks the line each
+// starts on
+static std::vector<TokType> filetokens(names* nmz, std::string path,
+        std::vector<int> lines = {}) {
+    fscanner scan(nmz);
+    std::vector<TokType> types;
+    EXPECT_TRUE(scan.open(path));
+    Token tk;
+    do {
+        tk = scan.step();
+        if (types.size() < lines.size()) {
+            EXPECT_EQ(lines[types.size()], tk.at.line()) << "token " << types.size();
+        }
+        types.push_back(tk.type);
+    } while (tk.type != EndOfFile);
+    return types;
+}
+
+static const char* const positiontext =
+    "dev A = SWITCH { // comment\r\n"
+    "\tInitialvalue : 1;\r"
+    "}\n"
+    "\r\n"
+    "\r"
+    "monitor A;\r";
+
+// An empty file has nothing to map, but is still opened and scanned
+// @author   Diesel
+TEST_F(ScannerTest, EmptyFile){
+    std::string path = writefile("scanner_unittest_empty.matt", "");
+    std::vector<TokType> types = filetokens(nmz, path);
+    ASSERT_EQ(1u, types.size());
+    EXPECT_EQ(EndOfFile, types[0]);
+
+    const char* b;
+    const char* e;
+    ASSERT_TRUE(SourcePos(path, 0).source(b, e));
+    EXPECT_EQ(b, e);
+    std::remove(path.c_str());
+}
+
+// Windows and old Mac line endings give the same tokens on the same lines
+// as Unix ones
+// @author   Diesel
+TEST_F(ScannerTest, CrlfAndLoneCr){
+    std::string lf = "dev A = SWITCH {\nInitialvalue : 1;\n}\n\n\nmonitor A;\n";
+    std::string crlf = "dev A = SWITCH {\r\nInitialvalue : 1;\r\n}\r\n\r\n\r\nmonitor A;\r\n";
+    std::string cr = "dev A = SWITCH {\rInitialvalue : 1;\r}\r\r\rmonitor A;\r";
+    std::vector<int> lines = {1, 1, 1, 1, 1, 2, 2, 2, 2, 3, 6, 6, 6};
+
+    std::vector<std::string> paths = {
+        writefile("scanner_unittest_lf.matt", lf),
+        writefile("scanner_unittest_crlf.matt", crlf),
+        writefile("scanner_unittest_cr.matt", cr),
+        writefile("scanner_unittest_mixed.matt", positiontext)};
+
+    std::vector<TokType> expected = filetokens(nmz, paths[0], lines);
+    for (const std::string& path : paths) {
+        SCOPED_TRACE(path);
+        EXPECT_EQ(expected, filetokens(nmz, path, lines));
+        std::remove(path.c_str());
+    }
+}
+
+// The line and column looked up from an offset are those counted by
+// reading the stream, whether the file is mapped or read as a stream
+// @author   Diesel
+TEST_F(ScannerTest, PositionsMatchStream){
+    std::string text = positiontext;
+    std::vector<linecol> expected = streampositions(text);
+
+    // mapped, looked up from every offset
+    std::string path = writefile("scanner_unittest_positions.matt", text);
+    fscanner scan(nmz);
+    ASSERT_TRUE(scan.open(path));
+    for (size_t i = 0; i < text.size(); i++) {
+        if (expected[i].line == 0)
+            continue;
+        SourcePos sp(path, i + 1);
+        EXPECT_EQ(expected[i].line, sp.line()) << "offset " << i;
+        EXPECT_EQ(expected[i].column, sp.column()) << "offset " << i;
+    }
+
+    // read as a stream, at each character as it is read
+    std::istringstream iss(text);
+    iposstream ips(&iss, "scanner_unittest_stream.matt");
+    for (size_t i = 0; i < text.size(); i++) {
+        ASSERT_NE('\0', ips.get());
+        SourcePos sp = ips.pos();
+        EXPECT_EQ(expected[i].line, sp.line()) << "offset " << i;
+        EXPECT_EQ(expected[i].column, sp.column()) << "offset " << i;
+        if (i + 1 < text.size() && expected[i + 1].line == 0)
+            i++;
+    }
+    std::remove(path.c_str());
+}
+
+// A mapped file is released when its scanner is done, and its source kept,
+// so that positions within it don't change when the file does
+// @author   Diesel
+TEST_F(ScannerTest, MappingReleasedWithScanner){
+    std::string path = writefile("scanner_unittest_release.matt", "dev A = SWITCH;\nmonitor A;\n");
+    const char* b;
+    const char* e;
+    {
+        fscanner scan(nmz);
+        ASSERT_TRUE(scan.open(path));
+        ASSERT_TRUE(SourcePos(path, 0).source(b, e));
+        EXPECT_EQ("dev A = SWITCH;\nmonitor A;\n", std::string(b, e));
+    }
+
+    writefile("scanner_unittest_release.matt", "monitor A;\r\nmonitor B;\n");
+    ASSERT_TRUE(SourcePos(path, 0).source(b, e));
+    EXPECT_EQ("dev A = SWITCH;\nmonitor A;\n", std::string(b, e));
+    EXPECT_EQ(1, SourcePos(path, 14).line());
+    EXPECT_EQ(14, SourcePos(path, 14).column());
+    std::remove(path.c_str());
+    EXPECT_EQ(2, SourcePos(path, 18).line());
+    EXPECT_EQ(2, SourcePos(path, 18).column());
+    ASSERT_TRUE(SourcePos(path, 0).source(b, e));
+    EXPECT_EQ("dev A = SWITCH;\nmonitor A;\n", std::string(b, e));
+}
+
+// Lines are counted the first time a position in a file is looked up, which
+// may be on any thread, e.g. one of a batch reporting a runtime error, while
+// other threads add files to the table
+// @author   Diesel
+TEST_F(ScannerTest, PositionsLookedUpOnThreads){
+    std::string text = positiontext;
+    std::vector<linecol> expected = streampositions(text);
+    std::string path = writefile("scanner_unittest_threads.matt", text);
+    std::vector<std::vector<linecol>> found(4, std::vector<linecol>(text.size()));
+    std::vector<std::thread> pool;
+    for (unsigned int t = 0; t < found.size(); t++) {
+        pool.push_back(std::thread([&, t]() {
+            for (size_t i = 0; i < text.size(); i++) {
+                SourcePos sp(path, i + 1);
+                found[t][i] = {sp.line(), sp.column()};
+                SourcePos("scanner_unittest_thread" + std::to_string(t) + "_"
+                          + std::to_string(i) + ".matt", 0);
+            }
+        }));
+    }
+    for (auto& th : pool)
+        th.join();
+
+    for (unsigned int t = 0; t < found.size(); t++) {
+        for (size_t i = 0; i < text.size(); i++) {
+            if (expected[i].line == 0)
+                continue;
+            EXPECT_EQ(expected[i].line, found[t][i].line) << "offset " << i;
+            EXPECT_EQ(expected[i].column, found[t][i].column) << "offset " << i;
+        }
+    }
+    std::remove(path.c_str());
+}
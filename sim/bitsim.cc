@@ -0,0 +1,975 @@
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <atomic>
+#include <thread>
+
+#include "../com/localestrings.h"
+#include "../com/formatstring.h"
+#include "bitword.h"
+#include "simkernel.h"
+#include "bitsim.h"
+
+
+/** A signal held as three bit planes, with one bit per lane:
+ *
+ *    falling   k=1 v=0 e=1      low      k=1 v=0 e=0
+ *    rising    k=1 v=1 e=1      high     k=1 v=1 e=0
+ *    floating  k=0 v=0 e=0      indet    k=0 v=0 e=1
+ *
+ *  k is set for known levels, v gives the level and e marks a transition.
+ */
+template <class W>
+struct bitsig {
+  W k, v, e;
+};
+
+
+/** Returns a bitsig with the same value in every lane.
+ */
+template <class W>
+static bitsig<W> uniform (asignal s)
+{
+  W z = W::zero (), o = W::ones ();
+  bitsig<W> r;
+  r.k = (s == falling || s == low || s == rising || s == high) ? o : z;
+  r.v = (s == rising || s == high) ? o : z;
+  r.e = (s == falling || s == rising || s == indet) ? o : z;
+  return r;
+}
+
+
+/** Returns the signal held in one lane of a set of planes.
+ */
+static asignal decode (bool k, bool v, bool e)
+{
+  if (k)
+    return v ? (e ? rising : high) : (e ? falling : low);
+  return e ? indet : floating;
+}
+
+
+/** Runs a bitsim for one word of lanes at a time, mirroring the sweep engine
+ *  in devices operation by operation.
+ *
+ * @author Diesel
+ */
+template <class W>
+struct bitrunner {
+  const simkernel& kern;
+  const devstate& start;            // the state every lane starts from
+  const settleoptions& opts;        // limit and policy for settling each cycle
+  typedef std::vector<bitsig<W>, bitwordallocator<bitsig<W> > > sigvector;
+  sigvector sig;                    // value of every signal
+  sigvector mem;                    // memory of every DTYPE
+  sigvector sw;                     // state of every switch
+  std::vector<int> counter, bitstrpos;
+  std::vector<int> period;          // period of every CLOCK and SIGGEN
+  W changed;                        // lanes changed in this machine cycle
+  std::deque<sigvector> seen;       // signals after recent machine cycles
+  int loopperiod[W::lanes];         // machine cycles in the loop of each lane
+  std::vector<W, bitwordallocator<W> > looping;  // lanes in which each device's outputs loop
+
+  bitrunner (const simkernel& k, const devstate& st, const settleoptions& o)
+    : kern (k), start (st), opts (o) {}
+
+  static W ishigh (const bitsig<W>& s) { return s.k & s.v & ~s.e; }
+  static W islow (const bitsig<W>& s) { return s.k & ~s.v & ~s.e; }
+  static W isindet (const bitsig<W>& s) { return ~s.k & s.e; }
+  static W sel (W m, W a, W b) { return (m & a) | (~m & b); }
+
+  /** Updates sig in the direction of target, as devices::signalupdate.
+   */
+  void signalupdate (const bitsig<W>& t, bitsig<W>& s)
+  {
+    W tindet = isindet (t), thigh = ishigh (t), tlow = islow (t);
+    W slow = s.k & ~s.v, shigh = s.k & s.v;
+    W sfloat = ~s.k & ~s.e, sindet = ~s.k & s.e;
+    bitsig<W> n;
+    n.k = ~tindet & (slow | shigh | sfloat | (sindet & t.k));
+    n.v = ~tindet & ((slow & thigh) | (shigh & ~tlow) | (sfloat & thigh) | (sindet & t.v));
+    n.e = tindet | ((slow & thigh) | (shigh & tlow) | sfloat | (sindet & t.e));
+    changed = changed | (n.k ^ s.k) | (n.v ^ s.v) | (n.e ^ s.e);
+    s = n;
+  }
+
+  /** Settles rising and falling outputs, as execclock and execsiggen.
+   */
+  void settle (bitsig<W>& s)
+  {
+    W e = s.e & ~s.k;
+    changed = changed | (e ^ s.e);
+    s.e = e;
+  }
+
+  void execgate (int i, asignal x, asignal y)
+  {
+    W match = W::zero (), anyindet = W::zero ();
+    for (int32_t k = kern.inbegin[i]; k < kern.inbegin[i + 1]; k++) {
+      const bitsig<W>& s = sig[kern.insig[k]];
+      match = match | ((x == high) ? islow (s) : ishigh (s));
+      anyindet = anyindet | isindet (s);
+    }
+    W indetm = anyindet & ~match;
+    bitsig<W> t;
+    t.k = ~indetm;
+    t.v = (y == high) ? (~match & ~indetm) : match;
+    t.e = indetm;
+    signalupdate (t, sig[kern.outbegin[i]]);
+  }
+
+  void execxorgate (int i)
+  {
+    const bitsig<W>& a = sig[kern.insig[kern.inbegin[i]]];
+    const bitsig<W>& b = sig[kern.insig[kern.inbegin[i] + 1]];
+    W eq = ~((a.k ^ b.k) | (a.v ^ b.v) | (a.e ^ b.e));
+    bitsig<W> t;
+    t.k = W::ones ();
+    t.v = ~eq;
+    t.e = W::zero ();
+    signalupdate (t, sig[kern.outbegin[i]]);
+  }
+
+  void execselect (int i)
+  {
+    const int32_t* in = &kern.insig[kern.inbegin[i]];
+    const bitsig<W>& s = sig[in[selsw]];
+    const bitsig<W>& h = sig[in[selhigh]];
+    const bitsig<W>& l = sig[in[sellow]];
+    W swhigh = ishigh (s), swindet = isindet (s) & ~swhigh;
+    bitsig<W> t;
+    t.k = sel (swhigh, h.k, sel (swindet, W::zero (), l.k));
+    t.v = sel (swhigh, h.v, sel (swindet, W::zero (), l.v));
+    t.e = sel (swhigh, h.e, sel (swindet, W::ones (), l.e));
+    signalupdate (t, sig[kern.outbegin[i]]);
+  }
+
+  void execdtype (int i)
+  {
+    const int32_t* in = &kern.insig[kern.inbegin[i]];
+    const bitsig<W>& data = sig[in[dtdata]];
+    const bitsig<W>& clk = sig[in[dtclk]];
+    const bitsig<W>& set = sig[in[dtset]];
+    const bitsig<W>& clr = sig[in[dtclear]];
+    bitsig<W>& m = mem[i];
+    W clkrise = clk.k & clk.v & clk.e;
+    W m1, m2;
+
+    // to indet
+    m1 = isindet (clk) | isindet (set) | isindet (clr) | (clkrise & data.k & data.e);
+    m.k = m.k & ~m1; m.v = m.v & ~m1; m.e = m.e | m1;
+    // to high, then low
+    m1 = (clkrise & ishigh (data)) | ishigh (set);
+    m2 = (clkrise & islow (data) & ~ishigh (set)) | ishigh (clr);
+    m1 = m1 & ~ishigh (clr);
+    m.k = m.k | m1 | m2;
+    m.v = (m.v | m1) & ~m2;
+    m.e = m.e & ~(m1 | m2);
+
+    bitsig<W> q = m, qbar;
+    qbar.k = m.k;
+    qbar.v = ~(m.k & m.v & ~m.e) & m.k;   // inv: indet stays, high is low, else high
+    qbar.e = m.e & ~m.k;
+    signalupdate (q, sig[kern.outbegin[i]]);
+    signalupdate (qbar, sig[kern.outbegin[i] + dtqbar]);
+  }
+
+  void execdevice (int i)
+  {
+    switch (kern.kind[i]) {
+      case aswitch:  signalupdate (sw[i], sig[kern.outbegin[i]]); break;
+      case aclock:
+      case siggen:   settle (sig[kern.outbegin[i]]); break;
+      case orgate:   execgate (i, low, low);   break;
+      case norgate:  execgate (i, low, high);  break;
+      case andgate:  execgate (i, high, high); break;
+      case nandgate: execgate (i, high, low);  break;
+      case xorgate:  execxorgate (i);          break;
+      case dtype:    execdtype (i);            break;
+      case aselect:  execselect (i);           break;
+      default:                                 break;
+    }
+  }
+
+  /** Puts every lane into the state left by devices::resetdevices.
+   */
+  void reset ()
+  {
+    int n = kern.devcount ();
+    sig.resize (start.sig.size ());
+    for (unsigned int s = 0; s < start.sig.size (); s++)
+      sig[s] = uniform<W> (start.sig[s]);
+    mem.assign (n, uniform<W> (low));
+    sw.assign (n, uniform<W> (low));
+    counter.assign (n, 0);
+    bitstrpos.assign (n, 0);
+    for (int i = 0; i < n; i++) {
+      devlink d = kern.dev[i];
+      int32_t out = kern.outbegin[i];
+      switch (kern.kind[i]) {
+        case aswitch:
+          sw[i] = uniform<W> (start.memory[i]);
+          break;
+        case aclock:
+        case orgate:
+        case norgate:
+        case andgate:
+        case nandgate:
+        case xorgate:
+          sig[out] = uniform<W> (low);
+          break;
+        case dtype:
+          sig[out] = uniform<W> (low);
+          sig[out + 1] = uniform<W> (high);
+          break;
+        case siggen:
+          if (!d->bitstr.empty ())
+            sig[out] = uniform<W> (d->bitstr[0] ? high : low);
+          break;
+        default:
+          break;
+      }
+    }
+  }
+
+  /** Advances the clocks and signal generators, as devices::updateclocks.
+   */
+  void updateclocks ()
+  {
+    for (int i = 0; i < kern.devcount (); i++) {
+      devlink d = kern.dev[i];
+      bitsig<W>& s = sig[kern.outbegin[i]];
+      if (kern.kind[i] == aclock) {
+        if (counter[i] == period[i]) {
+          W h = ishigh (s);
+          counter[i] = 0;
+          s.k = W::ones ();
+          s.v = ~h;
+          s.e = W::ones ();
+        }
+        counter[i]++;
+      }
+      else if (kern.kind[i] == siggen && !d->bitstr.empty ()) {
+        if (period[i] == 0 || counter[i] == period[i]) {
+          counter[i] = 0;
+          if (++bitstrpos[i] >= (int) d->bitstr.size ())
+            bitstrpos[i] = 0;
+          signalupdate (uniform<W> (d->bitstr[bitstrpos[i]] ? high : low), s);
+        }
+        counter[i]++;
+      }
+    }
+  }
+
+  /** Returns the lanes in which two signals differ.
+   */
+  static W differ (const bitsig<W>& a, const bitsig<W>& b)
+  {
+    return (a.k ^ b.k) | (a.v ^ b.v) | (a.e ^ b.e);
+  }
+
+  /** Puts the lanes given back to the signals and memories they had.
+   */
+  void hold (W lanes, const sigvector& oldsig, const sigvector& oldmem)
+  {
+    for (unsigned int g = 0; g < sig.size (); g++) {
+      sig[g].k = sel (lanes, oldsig[g].k, sig[g].k);
+      sig[g].v = sel (lanes, oldsig[g].v, sig[g].v);
+      sig[g].e = sel (lanes, oldsig[g].e, sig[g].e);
+    }
+    for (unsigned int i = 0; i < mem.size (); i++) {
+      mem[i].k = sel (lanes, oldmem[i].k, mem[i].k);
+      mem[i].v = sel (lanes, oldmem[i].v, mem[i].v);
+      mem[i].e = sel (lanes, oldmem[i].e, mem[i].e);
+    }
+  }
+
+  /** Finds the lanes given whose signals are the same as after one of the
+   *  last maxperiod machine cycles, as devices::repeated, and notes the
+   *  period of the loop of each.
+   *
+   * @return     The lanes whose signals repeated.
+   */
+  W repeated (W lanes)
+  {
+    uint64_t buf[W::words];
+    W found = W::zero ();
+    for (int k = seen.size () - 1; k >= 0 && lanes.any (); k--) {
+      W same = lanes;
+      for (unsigned int g = 0; g < sig.size () && same.any (); g++)
+        same = same & ~differ (sig[g], seen[k][g]);
+      if (!same.any ())
+        continue;
+      same.store (buf);
+      for (int l = 0; l < W::lanes; l++) {
+        if ((buf[l / 64] >> (l & 63)) & 1)
+          loopperiod[l] = seen.size () - k;
+      }
+      found = found | same;
+      lanes = lanes & ~same;
+    }
+    return found;
+  }
+
+  /** Runs machine cycles until none of the lanes given change, their
+   *  signals repeat, or the settle limit is reached, as
+   *  devices::runmachinecycles. Lanes whose signals repeat are held as they
+   *  are from then on, and changed is left with the lanes still changing.
+   *
+   * @return     The lanes whose signals repeated.
+   */
+  W settlelanes (W lanes)
+  {
+    int n = kern.devcount ();
+    int machinecycle = 0;
+    W looped = W::zero ();
+    sigvector oldsig, oldmem;
+    seen.assign (1, sig);
+    do {
+      machinecycle++;
+      changed = W::zero ();
+      if (looped.any ()) {
+        oldsig = sig;
+        oldmem = mem;
+      }
+      for (int i = 0; i < n; i++)
+        execdevice (i);
+      if (looped.any ())
+        hold (looped, oldsig, oldmem);
+      changed = changed & lanes & ~looped;
+      if (changed.any ()) {
+        W found = repeated (changed);
+        looped = looped | found;
+        changed = changed & ~found;
+        seen.push_back (sig);
+        if ((int) seen.size () > maxperiod)
+          seen.pop_front ();
+      }
+    } while (changed.any () && machinecycle < opts.limit);
+    seen.clear ();
+    return looped;
+  }
+
+  /** Goes round the loop of each lane given once more, or runs one machine
+   *  cycle in the other lanes given, as devices::findloop, noting the lanes
+   *  in which the outputs of each device change in looping.
+   */
+  void findloop (W lanes, W looped)
+  {
+    int n = kern.devcount ();
+    uint64_t buf[W::words];
+    int steps = 1;
+    looped = looped & lanes;
+    looped.store (buf);
+    for (int l = 0; l < W::lanes; l++) {
+      if ((buf[l / 64] >> (l & 63)) & 1)
+        steps = std::max (steps, loopperiod[l]);
+    }
+
+    looping.assign (n, W::zero ());
+    sigvector oldsig, oldmem;
+    for (int k = 1; k <= steps; k++) {
+      // the lanes whose loop has k machine cycles or more, and the others once
+      looped.store (buf);
+      for (int l = 0; l < W::lanes; l++) {
+        if (loopperiod[l] < k)
+          buf[l / 64] &= ~(1ULL << (l & 63));
+      }
+      W going = W::load (buf);
+      if (k == 1)
+        going = going | (lanes & ~looped);
+
+      oldsig = sig;
+      oldmem = mem;
+      for (int i = 0; i < n; i++)
+        execdevice (i);
+      hold (~going, oldsig, oldmem);
+      for (int i = 0; i < n; i++) {
+        for (int32_t g = kern.outbegin[i]; g < kern.outbegin[i + 1]; g++)
+          looping[i] = looping[i] | (differ (sig[g], oldsig[g]) & going);
+      }
+    }
+  }
+
+  /** Sets the outputs of the devices looping in the lanes given to indet,
+   *  as devices::markindet.
+   */
+  void markindet (W lanes)
+  {
+    int n = kern.devcount ();
+    for (int i = 0; i < n; i++) {
+      if (kern.kind[i] == aswitch || kern.kind[i] == aclock || kern.kind[i] == siggen)
+        continue;
+      W m = looping[i] & lanes;
+      for (int32_t g = kern.outbegin[i]; g < kern.outbegin[i + 1]; g++) {
+        sig[g].k = sig[g].k & ~m;
+        sig[g].v = sig[g].v & ~m;
+        sig[g].e = sig[g].e | m;
+      }
+    }
+  }
+
+  /** Simulates one word of lanes, starting at lane first, and records the
+   *  monitored signals into the trace.
+   */
+  void run (const std::vector<switchsettings>& lanes, const std::vector<int>& swdev,
+            int first, int ncycles, const std::vector<int32_t>& monsig, bittrace& tr)
+  {
+    int count = std::min ((int) lanes.size () - first, (int) W::lanes);
+    int base = first / 64;
+    uint64_t buf[W::words * 3];
+
+    reset ();
+
+    // Apply the switch settings of each lane
+    int setting = 0;
+    for (int l = 0; l < count; l++) {
+      for (auto& st : lanes[first + l]) {
+        int i = swdev[setting++];
+        bitsig<W> u = uniform<W> (st.second);
+        W* planes[3] = {&sw[i].k, &sw[i].v, &sw[i].e};
+        W* values[3] = {&u.k, &u.v, &u.e};
+        for (int p = 0; p < 3; p++) {
+          planes[p]->store (buf);
+          uint64_t bit = 1ULL << (l & 63);
+          uint64_t want = 0;
+          values[p]->store (buf + W::words);
+          want = buf[W::words + l / 64] & bit;
+          buf[l / 64] = (buf[l / 64] & ~bit) | want;
+          *planes[p] = W::load (buf);
+        }
+      }
+    }
+
+    W alive = W::zero ();
+    for (int l = 0; l < count; l++) {
+      alive.store (buf);
+      buf[l / 64] |= 1ULL << (l & 63);
+      alive = W::load (buf);
+    }
+
+    for (int c = 0; c < ncycles && alive.any (); c++) {
+      updateclocks ();
+      W looped = settlelanes (alive);
+
+      // as devices::executedevices, a loop only counts as settled with
+      // periodicconverge, and lanes which loop, or are still changing and
+      // not to be given up on, go round once more to find what changes
+      W failed = changed;
+      if (opts.criterion == steadyconverge)
+        failed = failed | looped;
+      W stepping = looped;
+      if (opts.policy != abortpolicy)
+        stepping = stepping | changed;
+      if (stepping.any ())
+        findloop (stepping, looped);
+
+      // lanes which failed to settle stop here with abortpolicy, as in
+      // userint::runnetwork, otherwise the cycle is noted and they go on
+      if (opts.policy == indetpolicy && failed.any ()) {
+        markindet (failed);
+        settlelanes (alive);
+      }
+      if (opts.policy == abortpolicy)
+        alive = alive & ~failed;
+      failed.store (buf);
+      for (int l = 0; l < count; l++) {
+        if (((buf[l / 64] >> (l & 63)) & 1) == 0)
+          continue;
+        if (opts.policy == abortpolicy)
+          tr.completed[first + l] = c;
+        else
+          tr.unsettled[first + l].push_back (c);
+      }
+
+      for (unsigned int m = 0; m < monsig.size (); m++) {
+        const bitsig<W> s = (monsig[m] < 0) ? uniform<W> (floating) : sig[monsig[m]];
+        uint64_t* dst = &tr.planes[((size_t) c * tr.nmons + m) * 3 * tr.nwords + base];
+        s.k.store (dst);
+        s.v.store (dst + tr.nwords);
+        s.e.store (dst + 2 * tr.nwords);
+      }
+    }
+  }
+
+  /** Returns the periods of the clocks and signal generators in the network.
+   */
+  static std::vector<int> periods (const simkernel& kern)
+  {
+    std::vector<int> p (kern.devcount (), 0);
+    for (int i = 0; i < kern.devcount (); i++) {
+      if (kern.kind[i] == aclock || kern.kind[i] == siggen)
+        p[i] = kern.dev[i]->frequency;
+    }
+    return p;
+  }
+
+  /** Sizes a trace for a number of lanes, all completing every cycle.
+   */
+  static void inittrace (bittrace& tr, int nlanes, int nmons, int ncycles)
+  {
+    tr.nlanes = nlanes;
+    tr.nmons = nmons;
+    tr.ncycles = ncycles;
+    tr.completed.assign (nlanes, ncycles);
+    tr.unsettled.assign (nlanes, std::vector<int> ());
+    tr.nwords = (nlanes + W::lanes - 1) / W::lanes * W::words;
+    tr.planes.assign ((size_t) ncycles * tr.nmons * 3 * tr.nwords, 0);
+  }
+
+  /** Simulates all the lanes, one word at a time.
+   */
+  static void runall (const simkernel& kern, const devstate& st, const settleoptions& opts,
+                      const std::vector<switchsettings>& lanes,
+                      const std::vector<int>& swdev, int ncycles,
+                      const std::vector<int32_t>& monsig, bittrace& tr)
+  {
+    bitrunner r (kern, st, opts);
+    int setting = 0;
+    std::vector<int> chunkdev;
+    r.period = periods (kern);
+    inittrace (tr, lanes.size (), monsig.size (), ncycles);
+    for (unsigned int first = 0; first < lanes.size (); first += W::lanes) {
+      // the switch devices of the settings in this chunk
+      chunkdev.clear ();
+      for (unsigned int l = first; l < lanes.size () && l < first + W::lanes; l++) {
+        for (unsigned int k = 0; k < lanes[l].size (); k++)
+          chunkdev.push_back (swdev[setting++]);
+      }
+      r.run (lanes, chunkdev, first, ncycles, monsig, tr);
+    }
+  }
+};
+
+
+/** Jobs of a batch which share clock periods and length, simulated as the
+ *  lanes of one run.
+ */
+struct batchgroup {
+  std::vector<int> period;          // period of every CLOCK and SIGGEN
+  int cycles;
+  std::vector<int> jobs;            // the job simulated in each lane
+  std::vector<switchsettings> lanes;
+  std::vector<int> swdev;           // switch device of each setting, in lane order
+  bittrace trace;
+};
+
+
+/** A word of lanes of a group, the unit of work handed to a thread.
+ */
+struct batchtask {
+  int group;
+  int first;                        // the first lane
+  std::vector<int> swdev;           // switch device of each setting in the word
+};
+
+
+/** Runs tasks until there are none left. Each thread has its own bitrunner,
+ *  and tasks write to separate words of the traces.
+ */
+template <class W>
+static void runtasks (const simkernel& kern, const devstate& st, const settleoptions& opts,
+                      std::vector<batchgroup>& groups, const std::vector<batchtask>& tasks,
+                      std::atomic<unsigned int>& next, const std::vector<int32_t>& monsig)
+{
+  bitrunner<W> r (kern, st, opts);
+  for (unsigned int t = next++; t < tasks.size (); t = next++) {
+    batchgroup& g = groups[tasks[t].group];
+    r.period = g.period;
+    r.run (g.lanes, tasks[t].swdev, tasks[t].first, g.cycles, monsig, g.trace);
+  }
+}
+
+
+/** Splits the groups into words of lanes, and runs them on nthreads threads.
+ */
+template <class W>
+static void runbatchwords (const simkernel& kern, const devstate& st, const settleoptions& opts,
+                           std::vector<batchgroup>& groups, const std::vector<int32_t>& monsig,
+                           int nthreads)
+{
+  std::vector<batchtask> tasks;
+  for (unsigned int gi = 0; gi < groups.size (); gi++) {
+    batchgroup& g = groups[gi];
+    int setting = 0;
+    bitrunner<W>::inittrace (g.trace, g.lanes.size (), monsig.size (), g.cycles);
+    for (unsigned int first = 0; first < g.lanes.size (); first += W::lanes) {
+      batchtask task;
+      task.group = gi;
+      task.first = first;
+      for (unsigned int l = first; l < g.lanes.size () && l < first + W::lanes; l++) {
+        for (unsigned int k = 0; k < g.lanes[l].size (); k++)
+          task.swdev.push_back (g.swdev[setting++]);
+      }
+      tasks.push_back (task);
+    }
+  }
+
+  std::atomic<unsigned int> next (0);
+  std::vector<std::thread> pool;
+  nthreads = std::min (nthreads, (int) tasks.size ());
+  for (int i = 1; i < nthreads; i++)
+    pool.push_back (std::thread (runtasks<W>, std::cref (kern), std::cref (st), std::cref (opts),
+                                 std::ref (groups), std::cref (tasks), std::ref (next),
+                                 std::cref (monsig)));
+  runtasks<W> (kern, st, opts, groups, tasks, next, monsig);
+  for (auto& th : pool)
+    th.join ();
+}
+
+
+/** Runs jobs of a group until there are none left, each from reset in a
+ *  simulation state of its own, executed by devices with its engine. Only
+ *  the states are written, the devices and the network are shared.
+ */
+static void runstates (devices* dmz, const devstate& st, const batchgroup& g,
+                       std::atomic<unsigned int>& next, const std::vector<int32_t>& monsig,
+                       std::vector<batchresult>& results)
+{
+  for (unsigned int l = next++; l < g.jobs.size (); l = next++) {
+    batchresult& r = results[g.jobs[l]];
+    devstate s = st;
+    bool ok = true;
+    dmz->resetdevices (s);
+    for (auto& sw : g.lanes[l])
+      dmz->setswitch (s, sw.first, sw.second, ok);
+
+    r.completed = g.cycles;
+    r.traces.assign (monsig.size (), std::vector<asignal> ());
+    for (int c = 0; c < g.cycles; c++) {
+      try {
+        dmz->executedevices (s, ok);
+      }
+      catch (const mattruntimeerror&) {
+        ok = false;   // an imported device failed to settle
+      }
+      // as in bitrunner::run, a cycle which fails to settle ends the job
+      // with abortpolicy, and is noted otherwise
+      if (!ok) {
+        r.completed = c;
+        break;
+      }
+      cycleresult res = dmz->lastcycle (s);
+      if (res != steadycycle && res != periodiccycle)
+        r.unsettled.push_back (c);
+      for (unsigned int m = 0; m < monsig.size (); m++)
+        r.traces[m].push_back ((monsig[m] < 0) ? floating : s.sig[monsig[m]]);
+    }
+  }
+}
+
+
+/** Runs the jobs of each group in turn on nthreads threads, one job to a
+ *  state, for networks which can't be simulated bit-parallel. devices
+ *  reads clock periods from the network, so they are set for each group
+ *  while it runs, and put back afterwards.
+ */
+static void runbatchstates (devices* dmz, const devstate& st, const std::vector<batchgroup>& groups,
+                            const std::vector<int32_t>& monsig, int nthreads,
+                            std::vector<batchresult>& results)
+{
+  const simkernel& kern = dmz->getkernel ();
+  std::vector<int> netperiod = bitrunner<bitword64>::periods (kern);
+  for (const batchgroup& g : groups) {
+    for (int i = 0; i < kern.devcount (); i++) {
+      if (kern.kind[i] == aclock || kern.kind[i] == siggen)
+        kern.dev[i]->frequency = g.period[i];
+    }
+
+    std::atomic<unsigned int> next (0);
+    std::vector<std::thread> pool;
+    int n = std::min (nthreads, (int) g.jobs.size ());
+    for (int i = 1; i < n; i++)
+      pool.push_back (std::thread (runstates, dmz, std::cref (st), std::cref (g), std::ref (next),
+                                   std::cref (monsig), std::ref (results)));
+    runstates (dmz, st, g, next, monsig, results);
+    for (auto& th : pool)
+      th.join ();
+  }
+
+  for (int i = 0; i < kern.devcount (); i++) {
+    if (kern.kind[i] == aclock || kern.kind[i] == siggen)
+      kern.dev[i]->frequency = netperiod[i];
+  }
+}
+
+
+/** Returns true if the network can be simulated bit-parallel, which it can
+ *  unless it has imported devices.
+ *
+ * @author Diesel
+ */
+bool bitsim::bitparallel (const simkernel& kern)
+{
+  for (int i = 0; i < kern.devcount (); i++) {
+    if (kern.kind[i] == imported)
+      return false;
+  }
+  return true;
+}
+
+
+/** Finds the signal of each monitor, or -1 if it is not connected.
+ *
+ * @author Diesel
+ */
+void bitsim::findmonitors (std::vector<int32_t>& monsig)
+{
+  monsig.clear ();
+  for (int m = 0; m < mmz->moncount (); m++) {
+    outplink o = mmz->getoutplink (m);
+    monsig.push_back (o ? o->sigid : -1);
+  }
+}
+
+
+/** Checks the network can be simulated bit-parallel, and finds the signals
+ *  of the monitors.
+ *
+ * @author Diesel
+ */
+bool bitsim::prepare (const simkernel& kern, std::vector<int32_t>& monsig, errorcollector& errs)
+{
+  for (int i = 0; i < kern.devcount (); i++) {
+    if (kern.kind[i] == imported) {
+      errs.report (mattruntimeerror (t("Imported devices can't be simulated bit-parallel."),
+                                     kern.dev[i]->definedAt));
+      return false;
+    }
+  }
+  findmonitors (monsig);
+  return true;
+}
+
+
+/** Resolves the switches named in a lane to their devices.
+ *
+ * @author Diesel
+ */
+bool bitsim::findswitches (const switchsettings& lane, std::vector<int>& swdev, errorcollector& errs)
+{
+  for (auto& st : lane) {
+    devlink d = netz->finddevice (st.first);
+    if (d == NULL || d->kind != aswitch) {
+      errs.report (mattruntimeerror (formatString (t("{0} is not a switch."), nmz->namestr (st.first)),
+                                     SourcePos ()));
+      return false;
+    }
+    swdev.push_back (d->index);
+  }
+  return true;
+}
+
+
+/** Simulates every lane from reset for a number of cycles.
+ *
+ * @author Diesel
+ */
+bool bitsim::run (const std::vector<switchsettings>& lanes, int ncycles,
+                  bittrace& result, errorcollector& errs)
+{
+  const simkernel& kern = dmz->getkernel ();
+  devstate st;
+  std::vector<int32_t> monsig;
+  if (!prepare (kern, monsig, errs))
+    return false;
+  dmz->getstate (st);
+
+  std::vector<int> swdev;
+  for (auto& lane : lanes) {
+    if (!findswitches (lane, swdev, errs))
+      return false;
+  }
+
+#ifdef __AVX512F__
+  if (lanes.size () > 256) {
+    bitrunner<bitword512>::runall (kern, st, dmz->getsettle (), lanes, swdev, ncycles, monsig, result);
+    return true;
+  }
+#endif
+#ifdef __AVX2__
+  if (lanes.size () > 64) {
+    bitrunner<bitword256>::runall (kern, st, dmz->getsettle (), lanes, swdev, ncycles, monsig, result);
+    return true;
+  }
+#endif
+  bitrunner<bitword64>::runall (kern, st, dmz->getsettle (), lanes, swdev, ncycles, monsig, result);
+  return true;
+}
+
+
+/** Simulates a batch of jobs on a pool of threads.
+ *
+ * @author Diesel
+ */
+bool bitsim::runbatch (const std::vector<batchjob>& jobs, int nthreads,
+                       std::vector<batchresult>& results, errorcollector& errs)
+{
+  const simkernel& kern = dmz->getkernel ();
+  devstate st;
+  std::vector<int32_t> monsig;
+  dmz->getstate (st);
+  findmonitors (monsig);
+
+  // Group the jobs by clock periods and length
+  std::vector<batchgroup> groups;
+  std::map<std::pair<std::vector<int>, int>, int> groupof;
+  std::vector<int> netperiod = bitrunner<bitword64>::periods (kern);
+  unsigned int widest = 0;
+  for (unsigned int j = 0; j < jobs.size (); j++) {
+    std::vector<int> period = netperiod;
+    for (auto& ck : jobs[j].clocks) {
+      devlink d = netz->finddevice (ck.first);
+      if (d == NULL || (d->kind != aclock && d->kind != siggen)) {
+        errs.report (mattruntimeerror (formatString (t("{0} is not a clock."), nmz->namestr (ck.first)),
+                                       SourcePos ()));
+        return false;
+      }
+      period[d->index] = ck.second;
+    }
+
+    auto key = std::make_pair (period, jobs[j].cycles);
+    auto it = groupof.find (key);
+    if (it == groupof.end ()) {
+      it = groupof.insert (std::make_pair (key, (int) groups.size ())).first;
+      groups.push_back (batchgroup ());
+      groups.back ().period = period;
+      groups.back ().cycles = jobs[j].cycles;
+    }
+    batchgroup& g = groups[it->second];
+    g.jobs.push_back (j);
+    g.lanes.push_back (jobs[j].switches);
+    if (!findswitches (jobs[j].switches, g.swdev, errs))
+      return false;
+    widest = std::max (widest, (unsigned int) g.lanes.size ());
+  }
+
+  if (nthreads <= 0)
+    nthreads = std::max (1u, std::thread::hardware_concurrency ());
+
+  results.assign (jobs.size (), batchresult ());
+  if (!bitparallel (kern)) {
+    runbatchstates (dmz, st, groups, monsig, nthreads, results);
+    return true;
+  }
+
+#if defined(__AVX512F__)
+  if (widest > 256)
+    runbatchwords<bitword512> (kern, st, dmz->getsettle (), groups, monsig, nthreads);
+  else
+#endif
+#if defined(__AVX2__)
+  if (widest > 64)
+    runbatchwords<bitword256> (kern, st, dmz->getsettle (), groups, monsig, nthreads);
+  else
+#endif
+  runbatchwords<bitword64> (kern, st, dmz->getsettle (), groups, monsig, nthreads);
+
+  for (auto& g : groups) {
+    for (unsigned int l = 0; l < g.jobs.size (); l++) {
+      batchresult& r = results[g.jobs[l]];
+      r.completed = g.trace.cycles (l);
+      r.unsettled = g.trace.unsettledcycles (l);
+      r.traces.assign (monsig.size (), std::vector<asignal> (r.completed));
+      for (unsigned int m = 0; m < monsig.size (); m++) {
+        for (int c = 0; c < r.completed; c++)
+          g.trace.getsignaltrace (l, m, c, r.traces[m][c]);
+      }
+    }
+  }
+  return true;
+}
+
+
+/** Returns the number of lanes evaluated in each machine word.
+ *
+ * @author Diesel
+ */
+int bitsim::wordlanes ()
+{
+#if defined(__AVX512F__)
+  return bitword512::lanes;
+#elif defined(__AVX2__)
+  return bitword256::lanes;
+#else
+  return bitword64::lanes;
+#endif
+}
+
+
+/** Initialises the bit-parallel simulator
+ *
+ * @author Diesel
+ */
+bitsim::bitsim (names* names_mod, network* network_mod, devices* devices_mod, monitor* monitor_mod)
+{
+  nmz = names_mod;
+  netz = network_mod;
+  dmz = devices_mod;
+  mmz = monitor_mod;
+}
+
+
+/** Returns the number of lanes in the run.
+ *
+ * @author Diesel
+ */
+int bittrace::lanes () const
+{
+  return nlanes;
+}
+
+
+/** Returns the number of monitors recorded.
+ *
+ * @author Diesel
+ */
+int bittrace::moncount () const
+{
+  return nmons;
+}
+
+
+/** Returns the number of cycles recorded for a lane.
+ *
+ * @author Diesel
+ */
+int bittrace::cycles (int lane) const
+{
+  return completed[lane];
+}
+
+
+/** Returns the cycles of a lane which did not settle.
+ *
+ * @author Diesel
+ */
+const std::vector<int>& bittrace::unsettledcycles (int lane) const
+{
+  return unsettled[lane];
+}
+
+
+/** Access recorded signal trace
+ *
+ * @author Diesel
+ */
+bool bittrace::getsignaltrace (int lane, int m, int c, asignal& s) const
+{
+  if (lane < 0 || lane >= nlanes || m < 0 || m >= nmons || c < 0 || c >= completed[lane])
+    return false;
+  const uint64_t* p = &planes[((size_t) c * nmons + m) * 3 * nwords + lane / 64];
+  int b = lane & 63;
+  s = decode ((p[0] >> b) & 1, (p[nwords] >> b) & 1, (p[2 * nwords] >> b) & 1);
+  return true;
+}
+
+
+/** Initialises an empty trace.
+ *
+ * @author Diesel
+ */
+bittrace::bittrace ()
+{
+  nlanes = nmons = ncycles = nwords = 0;
+}
@@ -0,0 +1,179 @@
+#ifndef GF2_BITSIM_H
+#define GF2_BITSIM_H
+
+#include <vector>
+#include <utility>
+#include <cstdint>
+
+#include "../com/names.h"
+#include "../com/errorhandler.h"
+#include "network.h"
+#include "devices.h"
+#include "monitor.h"
+
+
+/** Switch values for one lane of a bitsim run. Switches which are not listed
+ *  keep the state they have in the network.
+ */
+typedef std::vector<std::pair<name, asignal> > switchsettings;
+
+
+/** A run of the network for bitsim::runbatch, simulated from reset with its
+ *  own switch settings and clock periods. Switches and clocks which are not
+ *  listed keep their settings in the network.
+ */
+struct batchjob {
+  switchsettings switches;
+  std::vector<std::pair<name, int> > clocks;   // period of each CLOCK or SIGGEN
+  int cycles;
+};
+
+
+/** Monitor traces of a batchjob.
+ */
+struct batchresult {
+  int completed;                               // cycles simulated, see bittrace::cycles
+  std::vector<int> unsettled;                  // cycles carried on past, see bittrace::unsettledcycles
+  std::vector<std::vector<asignal> > traces;   // signal of each monitor on each cycle
+};
+
+
+/** Monitor traces recorded by bitsim, for every lane of a run.
+ *
+ *  Signals are stored bit-sliced, as three bit planes of each 64 lanes, for
+ *  every monitor and cycle.
+ *
+ * @author Diesel
+ */
+class bittrace {
+  int nlanes, nmons, ncycles, nwords;
+  std::vector<uint64_t> planes;      // [cycle][monitor][plane][word]
+  std::vector<int> completed;        // cycles recorded for each lane
+  std::vector<std::vector<int> > unsettled;  // cycles of each lane which did not settle
+
+  friend class bitsim;
+  template <class W> friend struct bitrunner;
+
+ public:
+  /** Returns the number of lanes in the run.
+   *
+   * @return     The number of switch settings that were simulated.
+   */
+  int lanes () const;
+
+  /** Returns the number of monitors recorded.
+   *
+   * @return     The number of monitors.
+   */
+  int moncount () const;
+
+  /** Returns the number of cycles recorded for a lane. This is less than the
+   *  number requested if the network failed to settle in that lane, with
+   *  abortpolicy.
+   *
+   * @param[in]  lane  The index of the lane.
+   * @return     The number of cycles recorded.
+   */
+  int cycles (int lane) const;
+
+  /** Returns the cycles of a lane which did not settle, and were carried on
+   *  past as the settle policy is not abortpolicy, see devices::setsettle.
+   *
+   * @param[in]  lane  The index of the lane.
+   * @return     The cycles, numbered from 0, in order.
+   */
+  const std::vector<int>& unsettledcycles (int lane) const;
+
+  /** Access recorded signal trace, as monitor::getsignaltrace.
+   *
+   * @param[in]  lane  The index of the lane
+   * @param[in]  m     The index of the monitor
+   * @param[in]  c     The cycle number to check
+   * @param      s     Returns the signal level.
+   * @return     True if successful, false otherwise.
+   */
+  bool getsignaltrace (int lane, int m, int c, asignal& s) const;
+
+  /** Initialises an empty trace.
+   */
+  bittrace ();
+};
+
+
+/** Bit-parallel simulator
+ *  Simulates a batch of switch settings at once, by holding every signal
+ *  as bit planes with one bit per lane, so each gate evaluation covers 64
+ *  lanes (256 or 512 when built for AVX2 or AVX-512). Each lane gives the
+ *  same traces as resetting the network, setting its switches and running
+ *  it with the sweep engine, with the same settle limit and policy. Loops
+ *  of signals are found in each lane as devices does, and a lane which
+ *  loops is held from then on while the others settle.
+ *
+ *  Imported devices are not supported, except by runbatch, which runs the
+ *  jobs of such a network through devices instead.
+ *
+ * @author Diesel
+ */
+class bitsim {
+  names*   nmz;
+  network* netz;
+  devices* dmz;
+  monitor* mmz;
+
+  static bool bitparallel (const simkernel& kern);
+  void findmonitors (std::vector<int32_t>& monsig);
+  bool prepare (const simkernel& kern, std::vector<int32_t>& monsig, errorcollector& errs);
+  bool findswitches (const switchsettings& lane, std::vector<int>& swdev, errorcollector& errs);
+
+ public:
+  /** Simulates every lane from reset for a number of cycles.
+   *
+   * @param[in]  lanes    The switch settings of each lane.
+   * @param[in]  ncycles  The number of clock cycles to simulate.
+   * @param      result   Returns the monitor traces of every lane.
+   * @param      errs     The errorcollector to report errors to.
+   * @return     False if the network can't be simulated or a setting does
+   *             not name a switch.
+   */
+  bool run (const std::vector<switchsettings>& lanes, int ncycles,
+            bittrace& result, errorcollector& errs);
+
+  /** Simulates a batch of jobs on a pool of threads. Jobs with the same clock
+   *  periods and length are simulated together as lanes of a bitsim run, and
+   *  each word of lanes is given to the next free thread. The compiled
+   *  network is shared by every thread, which only has its own signal and
+   *  state vectors.
+   *
+   *  A network with imported devices can't be simulated bit-parallel, so
+   *  each of its jobs is run from reset in a devstate of its own by
+   *  devices::executedevices instead, and each job is given to the next
+   *  free thread. Groups run one after another, as the clock periods of a
+   *  group are set in the network while it runs.
+   *
+   * @param[in]  jobs      The jobs to simulate.
+   * @param[in]  nthreads  The number of threads to use, or 0 for one per core.
+   * @param      results   Returns the monitor traces of each job.
+   * @param      errs      The errorcollector to report errors to.
+   * @return     False if a setting does not name a switch or clock.
+   */
+  bool runbatch (const std::vector<batchjob>& jobs, int nthreads,
+                 std::vector<batchresult>& results, errorcollector& errs);
+
+  /** Returns the number of lanes evaluated in each machine word.
+   *
+   * @return     64, 256 or 512 depending on the instruction set built for.
+   */
+  static int wordlanes ();
+
+  /** Initialises the bit-parallel simulator
+   *
+   * @param      names_mod    The names instance, for error messages.
+   * @param      network_mod  The network instance to use.
+   * @param      devices_mod  The devices instance, which holds the network state.
+   * @param      monitor_mod  The monitor instance, whose monitor points are traced.
+   */
+  bitsim (names* names_mod, network* network_mod, devices* devices_mod, monitor* monitor_mod);
+};
+
+
+#endif /* GF2_BITSIM_H */
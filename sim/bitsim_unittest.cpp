@@ -0,0 +1,307 @@
+/* Unit tests for the bit-parallel simulator.
+ * Every lane of a bitsim run is compared with the same switch settings
+ * simulated by devices with the sweep engine, monitor trace by monitor
+ * trace, with lanes packed into 64 bit words and into the widest word built
+ * for. Some lanes contain an oscillator, which fails to settle, and are run
+ * with each settle policy. A batch of a network with an imported device,
+ * which is run through devices instead, is checked the same way.
+ *
+ * Build with ARCHFLAGS=-mavx2 or -mavx512f to test the wider words.
+ *
+ * Tests require the google test framework
+ * https://github.com/google/googletest
+ *
+ * @author     Diesel
+ */
+
+
+#include "bitsim.h"
+#include "gtest/gtest.h"
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <cstdio>
+
+#include "../com/names.h"
+#include "../com/errorhandler.h"
+#include "../sim/network.h"
+#include "../sim/devices.h"
+#include "../sim/monitor.h"
+#include "../lang/scanner.h"
+#include "../lang/parser.h"
+
+
+// Gates, an xor, a dtype, a latch of gates, a gate feeding itself which
+// oscillates while OSC is high, and a ring of seven which runs while RUN is
+// high, and takes more than the settle limit to go round
+static const char* const definition =
+    "dev L1 = NAND;\n"
+    "dev L2 = NAND;\n"
+    "dev N = NAND;\n"
+    "dev R7 = NAND; dev R6 = NAND; dev R5 = NAND; dev R4 = NAND;\n"
+    "dev R3 = NAND; dev R2 = NAND; dev R1 = NAND;\n"
+    "dev A = SWITCH { Initialvalue : 0; }\n"
+    "dev B = SWITCH { Initialvalue : 0; }\n"
+    "dev C = SWITCH { Initialvalue : 0; }\n"
+    "dev OSC = SWITCH { Initialvalue : 0; }\n"
+    "dev RUN = SWITCH { Initialvalue : 0; }\n"
+    "dev CLK = CLOCK { Period : 2; }\n"
+    "dev G = NAND { I1 : A; I2 : B; }\n"
+    "dev X = XOR { I1 : G; I2 : C; }\n"
+    "dev FF = DTYPE { Data : X; CLK : CLK; }\n"
+    "dev L1 { I1 : A; I2 : L2; }\n"
+    "dev L2 { I1 : B; I2 : L1; }\n"
+    "dev N { I1 : OSC; I2 : N; }\n"
+    "dev M = AND { I1 : N; I2 : FF.Q; }\n"
+    "dev R1 { I1 : RUN; I2 : R7; }\n"
+    "dev R2 { I1 : R1; } dev R3 { I1 : R2; } dev R4 { I1 : R3; }\n"
+    "dev R5 { I1 : R4; } dev R6 { I1 : R5; } dev R7 { I1 : R6; }\n"
+    "monitor G, X, FF.Q, FF.QBAR, L1, L2, N, M, R7;\n";
+
+static const char* const switchnames[] = {"A", "B", "C", "OSC", "RUN"};
+static const int nswitches = 5;
+static const int ncycles = 12;
+
+// A latch of gates, imported by a network which sets it from a clock
+static const char* const latchdef =
+    "dev S = SWITCH { Initialvalue : 1; }\n"
+    "dev R = SWITCH { Initialvalue : 1; }\n"
+    "dev Q = NAND; dev QB = NAND;\n"
+    "dev Q { I1 : S; I2 : QB; }\n"
+    "dev QB { I1 : R; I2 : Q; }\n"
+    "monitor Q, QB;\n";
+
+static const char* const importdef =
+    "dev CLK = CLOCK { Period : 2; }\n"
+    "dev A = SWITCH { Initialvalue : 0; }\n"
+    "dev B = SWITCH { Initialvalue : 1; }\n"
+    "dev L = \"{0}\";\n"
+    "dev N = NAND { I1 : A; I2 : CLK; }\n"
+    "dev L { S : N; R : B; }\n"
+    "dev FF = DTYPE { Data : L.Q; CLK : CLK; }\n"
+    "monitor CLK, N, L.Q, L.QB, FF.Q;\n";
+
+
+// Bitsim test controller
+// @author   Diesel
+class BitsimTest : public ::testing::Test {
+    protected:
+
+    names* nmz;
+    network* netz;
+    devices* dmz;
+    monitor* mmz;
+    settleoptions opts;
+    std::string def = definition;
+
+    virtual void SetUp() {
+        nmz = new names();
+        netz = new network(nmz);
+        dmz = new devices(nmz, netz);
+        mmz = new monitor(nmz, netz, dmz);
+        strscanner smz(nmz, def);
+        parser pmz(netz, dmz, mmz, &smz, nmz);
+        ASSERT_TRUE(pmz.readin());
+        dmz->setsettle(opts);
+    }
+
+    virtual void TearDown() {
+        delete mmz;
+        delete dmz;
+        delete netz;
+        delete nmz;
+    }
+
+    // Switch settings counting up in binary, with RUN the highest bit
+    switchsettings lane(int n) {
+        switchsettings s;
+        for (int i = 0; i < nswitches; i++)
+            s.push_back({nmz->cvtname(switchnames[i]), ((n >> i) & 1) ? high : low});
+        return s;
+    }
+
+    void setpolicy(settlepolicy p, convergence crit = steadyconverge) {
+        opts.limit = 10;
+        opts.criterion = crit;
+        opts.policy = p;
+        dmz->setsettle(opts);
+    }
+
+    // Checks a lane of a bitsim run gives the traces of devices run from
+    // reset with the sweep engine, as userint::runnetwork does. Reset leaves
+    // the outputs of gates as they were, so each lane is run on a network
+    // read afresh, as the bitsim run was.
+    void testlane(const bittrace& bt, int l, int n) {
+        bool ok = true;
+        std::vector<int> unsettled;
+        TearDown();
+        SetUp();
+        for (auto& st : lane(n)) {
+            dmz->setswitch(st.first, st.second, ok);
+            ASSERT_TRUE(ok);
+        }
+        dmz->setengine(sweepengine);
+        dmz->resetdevices();
+        mmz->resetmonitor();
+        for (int c = 0; c < ncycles && ok; c++) {
+            dmz->executedevices(ok);
+            cycleresult r = dmz->lastcycle();
+            if (ok && (r == oscillatingcycle || r == limitcycle))
+                unsettled.push_back(c);
+            if (ok)
+                mmz->recordsignals();
+        }
+
+        ASSERT_EQ(mmz->cycles(), bt.cycles(l));
+        EXPECT_EQ(unsettled, bt.unsettledcycles(l));
+        ASSERT_EQ(mmz->moncount(), bt.moncount());
+        for (int m = 0; m < mmz->moncount(); m++) {
+            for (int c = 0; c < mmz->cycles(); c++) {
+                asignal want, got;
+                ASSERT_TRUE(mmz->getsignaltrace(m, c, want));
+                ASSERT_TRUE(bt.getsignaltrace(l, m, c, got));
+                EXPECT_EQ(want, got) << "monitor " << m << " cycle " << c;
+            }
+        }
+    }
+
+    // Runs a number of lanes through every switch setting in turn on a
+    // network read afresh, and checks each against devices
+    void testlanes(int nlanes, settlepolicy p, convergence crit = steadyconverge) {
+        std::vector<switchsettings> lanes;
+        bittrace bt;
+        errorcollector errs;
+        TearDown();
+        SetUp();
+        setpolicy(p, crit);
+        for (int l = 0; l < nlanes; l++)
+            lanes.push_back(lane(l % (1 << nswitches)));
+        ASSERT_TRUE(bitsim(nmz, netz, dmz, mmz).run(lanes, ncycles, bt, errs));
+        ASSERT_EQ(nlanes, bt.lanes());
+
+        for (int l = 0; l < nlanes; l++) {
+            SCOPED_TRACE("lane " + std::to_string(l));
+            testlane(bt, l, l % (1 << nswitches));
+        }
+    }
+};
+
+
+// One word of 64 lanes, so lanes of the same setting are in the same word
+// @author   Diesel
+TEST_F(BitsimTest, Word64MatchesDevices){
+    for (settlepolicy p : {abortpolicy, indetpolicy, continuepolicy}) {
+        SCOPED_TRACE("policy " + std::to_string(p));
+        testlanes(64, p);
+    }
+}
+
+// A loop of signals counts as settled
+// @author   Diesel
+TEST_F(BitsimTest, PeriodicConvergeMatchesDevices){
+    for (settlepolicy p : {abortpolicy, indetpolicy, continuepolicy}) {
+        SCOPED_TRACE("policy " + std::to_string(p));
+        testlanes(64, p, periodicconverge);
+    }
+}
+
+// More lanes than fit a 64 bit word, so they use the widest word built for,
+// and fill more than one of them
+// @author   Diesel
+TEST_F(BitsimTest, WidestWordMatchesDevices){
+    for (settlepolicy p : {abortpolicy, indetpolicy, continuepolicy}) {
+        SCOPED_TRACE("policy " + std::to_string(p));
+        testlanes(bitsim::wordlanes() + 17, p);
+    }
+}
+
+// The oscillator and the ring fail to settle in the lanes with OSC or RUN
+// high, and only those. With abortpolicy they stop at the first cycle, with
+// indetpolicy the oscillator is set to indet in the first cycle and stays
+// there, and with continuepolicy every cycle is carried on past.
+// @author   Diesel
+TEST_F(BitsimTest, UnsettledLanes){
+    std::vector<switchsettings> lanes = {lane(0), lane(8), lane(7), lane(15)};
+    errorcollector errs;
+
+    bittrace bt;
+    setpolicy(abortpolicy);
+    ASSERT_TRUE(bitsim(nmz, netz, dmz, mmz).run(lanes, ncycles, bt, errs));
+    EXPECT_EQ(ncycles, bt.cycles(0));
+    EXPECT_EQ(0, bt.cycles(1));
+    EXPECT_EQ(ncycles, bt.cycles(2));
+    EXPECT_EQ(0, bt.cycles(3));
+
+    for (settlepolicy p : {indetpolicy, continuepolicy}) {
+        bittrace bt;
+        size_t unsettled = (p == indetpolicy) ? 1 : ncycles;
+        setpolicy(p);
+        ASSERT_TRUE(bitsim(nmz, netz, dmz, mmz).run(lanes, ncycles, bt, errs));
+        for (int l = 0; l < 4; l++) {
+            EXPECT_EQ(ncycles, bt.cycles(l));
+            EXPECT_EQ((l % 2) ? unsettled : 0, bt.unsettledcycles(l).size());
+        }
+    }
+}
+
+// A network with an imported device can't be simulated bit-parallel, so its
+// batch is run through devices, a job to a state, on several threads. Each
+// job gives the traces of devices run on the network itself with the same
+// settings, and the clock keeps its period in the network afterwards.
+// @author   Diesel
+TEST_F(BitsimTest, BatchWithImportedDeviceMatchesDevices){
+    std::string path = ::testing::TempDir() + "bitsim_unittest_latch.matt";
+    std::ofstream(path.c_str()) << latchdef;
+    def = importdef;
+    def.replace(def.find("{0}"), 3, path);
+    TearDown();
+    SetUp();
+
+    std::vector<batchjob> jobs;
+    for (int period = 1; period <= 3; period++) {
+        for (int n = 0; n < 4; n++) {
+            batchjob job;
+            job.switches = {{nmz->cvtname("A"), (n & 1) ? high : low},
+                            {nmz->cvtname("B"), (n & 2) ? high : low}};
+            job.clocks = {{nmz->cvtname("CLK"), period}};
+            job.cycles = ncycles - n;
+            jobs.push_back(job);
+        }
+    }
+    std::vector<batchresult> results;
+    errorcollector errs;
+    ASSERT_TRUE(bitsim(nmz, netz, dmz, mmz).runbatch(jobs, 3, results, errs));
+    ASSERT_EQ(jobs.size(), results.size());
+    EXPECT_EQ(2, netz->finddevice(nmz->cvtname("CLK"))->frequency);
+
+    for (unsigned int j = 0; j < jobs.size(); j++) {
+        SCOPED_TRACE("job " + std::to_string(j));
+        bool ok = true;
+        TearDown();
+        SetUp();
+        for (auto& st : jobs[j].switches)
+            dmz->setswitch(st.first, st.second, ok);
+        dmz->setclock(jobs[j].clocks[0].first, jobs[j].clocks[0].second, ok);
+        ASSERT_TRUE(ok);
+        dmz->resetdevices();
+        mmz->resetmonitor();
+        for (int c = 0; c < jobs[j].cycles && ok; c++) {
+            dmz->executedevices(ok);
+            if (ok)
+                mmz->recordsignals();
+        }
+
+        ASSERT_EQ(mmz->cycles(), results[j].completed);
+        EXPECT_TRUE(results[j].unsettled.empty());
+        ASSERT_EQ((size_t) mmz->moncount(), results[j].traces.size());
+        for (int m = 0; m < mmz->moncount(); m++) {
+            for (int c = 0; c < mmz->cycles(); c++) {
+                asignal want;
+                ASSERT_TRUE(mmz->getsignaltrace(m, c, want));
+                EXPECT_EQ(want, results[j].traces[m][c]) << "monitor " << m << " cycle " << c;
+            }
+        }
+    }
+    std::remove(path.c_str());
+}
@@ -0,0 +1,104 @@
+#ifndef GF2_BITWORD_H
+#define GF2_BITWORD_H
+
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+#if defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif
+
+
+/** Machine words holding one bit per simulation lane, used by bitsim.
+ *
+ *  Each type provides the bitwise operators, zero() and ones() constants,
+ *  any() to test for a set bit, and load/store to an array of 64 bit words.
+ *  lanes is the number of bits, and words the number of uint64_t it spans.
+ *  The wider types are only available when the compiler targets AVX2 or
+ *  AVX-512, see ARCHFLAGS in the Makefile.
+ *
+ * @author Diesel
+ */
+struct bitword64 {
+  enum { lanes = 64, words = 1 };
+  uint64_t w;
+
+  static bitword64 zero () { bitword64 r; r.w = 0; return r; }
+  static bitword64 ones () { bitword64 r; r.w = ~0ULL; return r; }
+  static bitword64 load (const uint64_t* p) { bitword64 r; r.w = p[0]; return r; }
+  void store (uint64_t* p) const { p[0] = w; }
+  bool any () const { return w != 0; }
+
+  bitword64 operator& (bitword64 b) const { bitword64 r; r.w = w & b.w; return r; }
+  bitword64 operator| (bitword64 b) const { bitword64 r; r.w = w | b.w; return r; }
+  bitword64 operator^ (bitword64 b) const { bitword64 r; r.w = w ^ b.w; return r; }
+  bitword64 operator~ () const { bitword64 r; r.w = ~w; return r; }
+};
+
+
+#ifdef __AVX2__
+struct bitword256 {
+  enum { lanes = 256, words = 4 };
+  __m256i w;
+
+  static bitword256 zero () { bitword256 r; r.w = _mm256_setzero_si256 (); return r; }
+  static bitword256 ones () { bitword256 r; r.w = _mm256_set1_epi64x (-1); return r; }
+  static bitword256 load (const uint64_t* p) { bitword256 r; r.w = _mm256_loadu_si256 ((const __m256i*) p); return r; }
+  void store (uint64_t* p) const { _mm256_storeu_si256 ((__m256i*) p, w); }
+  bool any () const { return !_mm256_testz_si256 (w, w); }
+
+  bitword256 operator& (bitword256 b) const { bitword256 r; r.w = _mm256_and_si256 (w, b.w); return r; }
+  bitword256 operator| (bitword256 b) const { bitword256 r; r.w = _mm256_or_si256 (w, b.w); return r; }
+  bitword256 operator^ (bitword256 b) const { bitword256 r; r.w = _mm256_xor_si256 (w, b.w); return r; }
+  bitword256 operator~ () const { return *this ^ ones (); }
+};
+#endif /* __AVX2__ */
+
+
+#ifdef __AVX512F__
+struct bitword512 {
+  enum { lanes = 512, words = 8 };
+  __m512i w;
+
+  static bitword512 zero () { bitword512 r; r.w = _mm512_setzero_si512 (); return r; }
+  static bitword512 ones () { bitword512 r; r.w = _mm512_set1_epi64 (-1); return r; }
+  static bitword512 load (const uint64_t* p) { bitword512 r; r.w = _mm512_loadu_si512 (p); return r; }
+  void store (uint64_t* p) const { _mm512_storeu_si512 (p, w); }
+  bool any () const { return _mm512_test_epi64_mask (w, w) != 0; }
+
+  bitword512 operator& (bitword512 b) const { bitword512 r; r.w = _mm512_and_si512 (w, b.w); return r; }
+  bitword512 operator| (bitword512 b) const { bitword512 r; r.w = _mm512_or_si512 (w, b.w); return r; }
+  bitword512 operator^ (bitword512 b) const { bitword512 r; r.w = _mm512_xor_si512 (w, b.w); return r; }
+  bitword512 operator~ () const { return *this ^ ones (); }
+};
+#endif /* __AVX512F__ */
+
+
+/** Allocator for containers of bitwords, as std::allocator does not respect
+ *  the alignment of the vector types before C++17.
+ *
+ * @author Diesel
+ */
+template <class T>
+struct bitwordallocator {
+  typedef T value_type;
+
+  bitwordallocator () {}
+  template <class U> bitwordallocator (const bitwordallocator<U>&) {}
+
+  T* allocate (std::size_t n)
+  {
+    void* p = NULL;
+    if (posix_memalign (&p, alignof (T) < sizeof (void*) ? sizeof (void*) : alignof (T), n * sizeof (T)))
+      throw std::bad_alloc ();
+    return static_cast<T*> (p);
+  }
+  void deallocate (T* p, std::size_t) { free (p); }
+
+  template <class U> bool operator== (const bitwordallocator<U>&) const { return true; }
+  template <class U> bool operator!= (const bitwordallocator<U>&) const { return false; }
+};
+
+
+#endif /* GF2_BITWORD_H */
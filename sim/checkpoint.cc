@@ -0,0 +1,380 @@
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+#include "importeddevice.h"
+#include "checkpoint.h"
+
+
+static const char magic[4] = {'M', 'C', 'K', '2'};
+
+
+/** Writes an unsigned integer seven bits to a byte, low bits first.
+ */
+static void writeuint (std::ostream& os, uint64_t n)
+{
+  while (n >= 0x80) {
+    os.put ((char) ((n & 0x7f) | 0x80));
+    n >>= 7;
+  }
+  os.put ((char) n);
+}
+
+
+/** Reads an integer written by writeuint, failing if it is more than max.
+ */
+static bool readuint (std::istream& is, uint64_t& n, uint64_t max)
+{
+  int c, shift = 0;
+  n = 0;
+  do {
+    c = is.get ();
+    if (c == EOF || shift > 56)
+      return false;
+    n |= (uint64_t) (c & 0x7f) << shift;
+    shift += 7;
+  } while (c & 0x80);
+  return n <= max;
+}
+
+
+/** Writes a 64 bit word as eight bytes, low byte first.
+ */
+static void writeword (std::ostream& os, uint64_t n)
+{
+  for (int i = 0; i < 8; i++, n >>= 8)
+    os.put ((char) (n & 0xff));
+}
+
+
+/** Reads a word written by writeword.
+ */
+static bool readword (std::istream& is, uint64_t& n)
+{
+  n = 0;
+  for (int i = 0; i < 8; i++) {
+    int c = is.get ();
+    if (c == EOF)
+      return false;
+    n |= (uint64_t) c << (8 * i);
+  }
+  return true;
+}
+
+
+/** Mixes a value into a hash.
+ */
+static uint64_t mix (uint64_t h, uint64_t v)
+{
+  h ^= v + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+  return h;
+}
+
+
+/** Writes signals packed two to a byte.
+ */
+static void writesignals (std::ostream& os, const std::vector<asignal>& s)
+{
+  for (unsigned int i = 0; i < s.size (); i += 2)
+    os.put ((char) (s[i] | ((i + 1 < s.size ()) ? s[i + 1] << 4 : 0)));
+}
+
+
+/** Reads signals written by writesignals into s, which is already sized.
+ */
+static bool readsignals (std::istream& is, std::vector<asignal>& s)
+{
+  for (unsigned int i = 0; i < s.size (); i += 2) {
+    int c = is.get ();
+    if (c == EOF || (c & 0x0f) > indet || (c >> 4) > indet)
+      return false;
+    s[i] = (asignal) (c & 0x0f);
+    if (i + 1 < s.size ())
+      s[i + 1] = (asignal) (c >> 4);
+  }
+  return true;
+}
+
+
+/** Hashes what a state depends on in a compiled network: the kind and
+ *  wiring of each device, and the settings of clocks and signal generators.
+ *  Imported modules are hashed with their own states.
+ *
+ * @author Diesel
+ */
+uint64_t checkpoint::fingerprint (const simkernel& kern)
+{
+  uint64_t h = mix (kern.devcount (), kern.sigcount ());
+  for (int i = 0; i < kern.devcount (); i++) {
+    devlink d = kern.dev[i];
+    h = mix (h, kern.kind[i]);
+    h = mix (h, kern.outbegin[i + 1] - kern.outbegin[i]);
+    h = mix (h, kern.inbegin[i + 1] - kern.inbegin[i]);
+    for (int32_t k = kern.inbegin[i]; k < kern.inbegin[i + 1]; k++)
+      h = mix (h, kern.insig[k]);
+    if (kern.kind[i] == aclock || kern.kind[i] == siggen)
+      h = mix (h, d->frequency);
+    if (kern.kind[i] == siggen) {
+      h = mix (h, d->bitstr.size ());
+      for (bool b : d->bitstr)
+        h = mix (h, b);
+    }
+  }
+  return h;
+}
+
+
+/** Writes a devstate, and those of its imported devices in turn.
+ *
+ * @author Diesel
+ */
+void checkpoint::writestate (devices* dmz, const devstate& s, std::ostream& os)
+{
+  const simkernel& kern = dmz->getkernel ();
+  int k = 0;
+  writeuint (os, kern.devcount ());
+  writeuint (os, s.sig.size ());
+  writeword (os, fingerprint (kern));
+  writesignals (os, s.sig);
+  writesignals (os, s.memory);
+  for (int i = 0; i < kern.devcount (); i++) {
+    switch (kern.kind[i]) {
+      case aclock:   writeuint (os, s.counter[i]);                 break;
+      case siggen:   writeuint (os, s.counter[i]);
+                     writeuint (os, s.bitstrpos[i]);               break;
+      case imported: writestate (kern.dev[i]->device->module->dmz,
+                                 s.imported[k++], os);             break;
+      default:                                                     break;
+    }
+  }
+}
+
+
+/** Reads a devstate written by writestate. s is first made a copy of the
+ *  current state, so only the values written need to be read. Counters
+ *  are checked against the settings of their devices, which count up to
+ *  their frequency, see devices::updateclocks.
+ *
+ * @author Diesel
+ */
+bool checkpoint::readstate (devices* dmz, devstate& s, std::istream& is)
+{
+  const simkernel& kern = dmz->getkernel ();
+  uint64_t n, nsig, h;
+  int k = 0;
+  dmz->getstate (s);
+  if (!readuint (is, n, kern.devcount ()) || (int) n != kern.devcount ()
+      || !readuint (is, nsig, s.sig.size ()) || nsig != s.sig.size ()
+      || !readword (is, h) || h != fingerprint (kern)
+      || !readsignals (is, s.sig) || !readsignals (is, s.memory))
+    return false;
+
+  for (int i = 0; i < kern.devcount (); i++) {
+    devlink d = kern.dev[i];
+    switch (kern.kind[i]) {
+      case aclock:
+        if (!readuint (is, n, std::max (d->frequency, 0)))
+          return false;
+        s.counter[i] = n;
+        break;
+      case siggen:
+        // a generator with no period is updated every cycle, and counts to 1
+        if (!readuint (is, n, std::max (d->frequency, 1)))
+          return false;
+        s.counter[i] = n;
+        if (!readuint (is, n, d->bitstr.empty () ? 0 : d->bitstr.size () - 1))
+          return false;
+        s.bitstrpos[i] = n;
+        break;
+      case imported:
+        if (!readstate (d->device->module->dmz, s.imported[k++], is))
+          return false;
+        break;
+      default:
+        break;
+    }
+  }
+  s.ready = false;
+  s.quiet = false;
+  return true;
+}
+
+
+/** Checks a block read by readtrace holds the number of samples given, so
+ *  tracebuffer::get can't read past its end. Runs must end in order at the
+ *  end of the block, and only full blocks are run length encoded.
+ *
+ * @author Diesel
+ */
+bool checkpoint::validblock (const std::vector<uint8_t>& data, bool rle, int samples)
+{
+  unsigned int i;
+  if (!rle) {
+    if ((int) data.size () != (samples + 1) / 2)
+      return false;
+    for (i = 0; i < data.size (); i++) {
+      if ((data[i] & 0x0f) > indet || (data[i] >> 4) > indet)
+        return false;
+    }
+    return true;
+  }
+  if (samples != tracebuffer::blocksize || data.size () < 2 || data.size () % 2)
+    return false;
+  for (i = 0; i < data.size (); i += 2) {
+    if (data[i + 1] > indet || (i > 0 && data[i] <= data[i - 2]))
+      return false;
+  }
+  return data[i - 2] == tracebuffer::blocksize - 1;
+}
+
+
+/** Writes the history of a monitor, block by block as it is held.
+ *
+ * @author Diesel
+ */
+void checkpoint::writetrace (const tracebuffer& t, std::ostream& os)
+{
+  writeuint (os, t.capacity);
+  writeuint (os, t.first);
+  writeuint (os, t.count);
+  writeuint (os, t.blocks.size ());
+  for (const tracebuffer::traceblock& b : t.blocks) {
+    os.put (b.rle ? 1 : 0);
+    writeuint (os, b.data.size ());
+    os.write ((const char*) b.data.data (), b.data.size ());
+  }
+}
+
+
+/** Reads the history of a monitor written by writetrace.
+ *
+ * @author Diesel
+ */
+bool checkpoint::readtrace (tracebuffer& t, std::istream& is)
+{
+  const int bs = tracebuffer::blocksize;
+  uint64_t capacity, first, count, nblocks, size;
+  if (!readuint (is, capacity, INT32_MAX) || capacity < 1
+      || !readuint (is, first, bs - 1)
+      || !readuint (is, count, capacity)
+      || !readuint (is, nblocks, (first + count + bs - 1) / bs)
+      || nblocks != (first + count + bs - 1) / bs)
+    return false;
+
+  t.clear ();
+  t.capacity = capacity;
+  t.first = first;
+  t.count = count;
+  for (uint64_t n = 0; n < nblocks; n++) {
+    t.blocks.push_back (tracebuffer::traceblock ());
+    tracebuffer::traceblock& b = t.blocks.back ();
+    int rle = is.get ();
+    if ((rle != 0 && rle != 1) || !readuint (is, size, bs))
+      return false;
+    b.rle = rle;
+    b.data.resize (size);
+    is.read ((char*) b.data.data (), size);
+    if (!is || !validblock (b.data, b.rle, std::min<uint64_t> (bs, first + count - n * bs)))
+      return false;
+    if (!b.rle)
+      b.data.reserve (bs / 2);
+  }
+  return true;
+}
+
+
+/** Takes a snapshot of the current simulation.
+ *
+ * @author Diesel
+ */
+void checkpoint::take (devices* dmz, monitor* mmz, int ncycles)
+{
+  dmz->getstate (state);
+  mmz->gethistory (history);
+  cycles = ncycles;
+}
+
+
+/** Takes the simulation back to the snapshot.
+ *
+ * @author Diesel
+ */
+int checkpoint::restore (devices* dmz, monitor* mmz)
+{
+  if (empty ())
+    return -1;
+  devstate s = state;
+  dmz->swapstate (s);
+  if (s.revision != state.revision)
+    return -1;  // s was a state of another network, and is now a copy of ours
+  if (!mmz->sethistory (history))
+    mmz->resetmonitor ();
+  return cycles;
+}
+
+
+/** Writes the checkpoint to a binary stream.
+ *
+ * @author Diesel
+ */
+bool checkpoint::write (devices* dmz, std::ostream& os)
+{
+  if (empty ())
+    return false;
+  os.write (magic, sizeof (magic));
+  writeuint (os, cycles);
+  writestate (dmz, state, os);
+  writeuint (os, history.size ());
+  for (const tracebuffer& t : history)
+    writetrace (t, os);
+  return (bool) os;
+}
+
+
+/** Reads a checkpoint written by write.
+ *
+ * @author Diesel
+ */
+bool checkpoint::read (devices* dmz, std::istream& is)
+{
+  char m[sizeof (magic)];
+  uint64_t n;
+  cycles = -1;
+  history.clear ();
+  if (!is.read (m, sizeof (magic)) || memcmp (m, magic, sizeof (magic)) != 0
+      || !readuint (is, n, INT32_MAX) || !readstate (dmz, state, is))
+    return false;
+  int ncycles = n;
+
+  if (!readuint (is, n, maxmonitors))
+    return false;
+  history.resize (n);
+  for (tracebuffer& t : history) {
+    if (!readtrace (t, is)) {
+      history.clear ();
+      return false;
+    }
+  }
+  cycles = ncycles;
+  return true;
+}
+
+
+/** Returns true if no snapshot has been taken or read.
+ *
+ * @author Diesel
+ */
+bool checkpoint::empty () const
+{
+  return cycles < 0;
+}
+
+
+/** Initialises an empty checkpoint
+ *
+ * @author Diesel
+ */
+checkpoint::checkpoint ()
+{
+  cycles = -1;
+}
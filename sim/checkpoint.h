@@ -0,0 +1,88 @@
+#ifndef GF2_CHECKPOINT_H
+#define GF2_CHECKPOINT_H
+
+#include <vector>
+#include <iostream>
+#include <cstdint>
+
+#include "devices.h"
+#include "monitor.h"
+#include "tracebuffer.h"
+
+
+/** A snapshot of a simulation: the state of the devices, the history of the
+ *  monitors and the number of cycles completed. A simulation can be taken
+ *  back to a checkpoint any number of times, e.g. to try several switch
+ *  settings after one long warm-up.
+ *
+ *  Checkpoints can be written to a stream in a compact binary form, and read
+ *  back for the same network, which is checked by a hash of its devices,
+ *  their wiring and the settings of its clocks. Signals and settings are packed two to a byte,
+ *  counters are written as variable length integers and monitor histories
+ *  are written as held by tracebuffer, so mostly run length encoded. The
+ *  engine worklists are not written, so a checkpoint read from a stream
+ *  starts with every device being executed.
+ *
+ * @author Diesel
+ */
+class checkpoint {
+  devstate state;                     // state of the devices
+  std::vector<tracebuffer> history;   // history of each monitor
+  int cycles;                         // cycles completed, or -1 if empty
+
+  static uint64_t fingerprint (const simkernel& kern);
+  static void writestate (devices* dmz, const devstate& s, std::ostream& os);
+  static bool readstate (devices* dmz, devstate& s, std::istream& is);
+  static void writetrace (const tracebuffer& t, std::ostream& os);
+  static bool readtrace (tracebuffer& t, std::istream& is);
+  static bool validblock (const std::vector<uint8_t>& data, bool rle, int samples);
+
+ public:
+  /** Takes a snapshot of the current simulation.
+   *
+   * @param      dmz     The devices being simulated.
+   * @param      mmz     The monitors of the network.
+   * @param[in]  ncycles The number of cycles completed.
+   */
+  void take (devices* dmz, monitor* mmz, int ncycles);
+
+  /** Takes the simulation back to the snapshot. If the monitors have
+   *  changed since, their history is cleared instead.
+   *
+   * @param      dmz   The devices being simulated.
+   * @param      mmz   The monitors of the network.
+   * @return     The number of cycles completed at the snapshot, or -1 if
+   *             the checkpoint is empty or the network has changed.
+   */
+  int restore (devices* dmz, monitor* mmz);
+
+  /** Writes the checkpoint to a binary stream.
+   *
+   * @param      dmz   The devices the checkpoint was taken from.
+   * @param      os    The stream to write to.
+   * @return     False if the checkpoint is empty or could not be written.
+   */
+  bool write (devices* dmz, std::ostream& os);
+
+  /** Reads a checkpoint written by write. The checkpoint is left empty if
+   *  the stream is not a checkpoint of the same network.
+   *
+   * @param      dmz   The devices the checkpoint is for.
+   * @param      is    The stream to read from.
+   * @return     False if the checkpoint could not be read.
+   */
+  bool read (devices* dmz, std::istream& is);
+
+  /** Returns true if no snapshot has been taken or read.
+   *
+   * @return     True if the checkpoint is empty.
+   */
+  bool empty () const;
+
+  /** Initialises an empty checkpoint
+   */
+  checkpoint ();
+};
+
+
+#endif /* GF2_CHECKPOINT_H */
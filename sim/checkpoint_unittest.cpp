@@ -0,0 +1,215 @@
+/* Unit tests for checkpoints.
+ * A simulation is saved to a stream part way through, read back and
+ * continued, and its monitor traces compared with those of a run which was
+ * never interrupted. Streams which are cut short or corrupted, or are of
+ * another network, must be rejected, leaving the checkpoint empty.
+ *
+ * Tests require the google test framework
+ * https://github.com/google/googletest
+ *
+ * @author     Diesel
+ */
+
+
+#include "checkpoint.h"
+#include "gtest/gtest.h"
+
+#include <string>
+#include <sstream>
+#include <vector>
+
+#include "../com/names.h"
+#include "../sim/network.h"
+#include "../sim/devices.h"
+#include "../sim/monitor.h"
+#include "../lang/scanner.h"
+#include "../lang/parser.h"
+
+
+// A network with state in each kind of device a checkpoint holds: clock
+// counters, signal generator positions, a dtype and a latch of gates
+static const char* const definition =
+    "dev S = NAND;\n"
+    "dev Q = NAND;\n"
+    "dev CLK = CLOCK { Period : 3; }\n"
+    "dev DATA = SIGGEN { Period : 2; Sig : $0110100; }\n"
+    "dev FF = DTYPE { Data : DATA; CLK : CLK; }\n"
+    "dev S { I1 : FF.Q; I2 : Q; }\n"
+    "dev Q { I1 : FF.QBAR; I2 : S; }\n"
+    "monitor CLK, DATA, FF.Q, S, Q;\n";
+
+
+// Checkpoint test controller
+// @author   Diesel
+class CheckpointTest : public ::testing::Test {
+    protected:
+
+    names* nmz;
+    network* netz;
+    devices* dmz;
+    monitor* mmz;
+    std::string def = definition;
+
+    virtual void SetUp() {
+        nmz = new names();
+        netz = new network(nmz);
+        dmz = new devices(nmz, netz);
+        mmz = new monitor(nmz, netz, dmz);
+        strscanner smz(nmz, def);
+        parser pmz(netz, dmz, mmz, &smz, nmz);
+        ASSERT_TRUE(pmz.readin());
+        dmz->resetdevices();
+        mmz->resetmonitor();
+    }
+
+    virtual void TearDown() {
+        delete mmz;
+        delete dmz;
+        delete netz;
+        delete nmz;
+    }
+
+    void run(int ncycles) {
+        bool ok;
+        for (int c = 0; c < ncycles; c++) {
+            dmz->executedevices(ok);
+            ASSERT_TRUE(ok);
+            mmz->recordsignals();
+        }
+    }
+
+    // Returns each monitor's trace as text
+    std::vector<std::string> traces() {
+        std::vector<std::string> t(mmz->moncount());
+        asignal s;
+        for (int m = 0; m < mmz->moncount(); m++) {
+            for (int c = 0; c < mmz->cycles(); c++) {
+                EXPECT_TRUE(mmz->getsignaltrace(m, c, s));
+                t[m] += "f_r-zX"[s];
+            }
+        }
+        return t;
+    }
+
+    // Returns a checkpoint of the simulation after some cycles, as written
+    std::string saved(int ncycles) {
+        checkpoint cp;
+        std::ostringstream os;
+        run(ncycles);
+        cp.take(dmz, mmz, ncycles);
+        EXPECT_TRUE(cp.write(dmz, os));
+        return os.str();
+    }
+
+    // Reads the network again, with one change to its definition
+    void redefine(const std::string& from, const std::string& to) {
+        size_t at = def.find(from);
+        ASSERT_NE(std::string::npos, at);
+        def.replace(at, from.size(), to);
+        TearDown();
+        SetUp();
+    }
+
+    // Checks a stream is rejected, leaving the checkpoint empty
+    void testrejected(const std::string& data) {
+        checkpoint cp;
+        std::istringstream is(data);
+        EXPECT_FALSE(cp.read(dmz, is));
+        EXPECT_TRUE(cp.empty());
+        EXPECT_EQ(-1, cp.restore(dmz, mmz));
+    }
+};
+
+
+// Saving, loading and continuing gives the same traces as running straight
+// through. The save is after more than one block of history.
+// @author   Diesel
+TEST_F(CheckpointTest, ResumeMatchesUninterruptedRun){
+    std::string data = saved(300);
+    run(300);
+    std::vector<std::string> expected = traces();
+
+    // start again, and wander off before loading
+    dmz->resetdevices();
+    mmz->resetmonitor();
+    run(17);
+
+    checkpoint cp;
+    std::istringstream is(data);
+    ASSERT_TRUE(cp.read(dmz, is));
+    EXPECT_FALSE(cp.empty());
+    EXPECT_EQ(300, cp.restore(dmz, mmz));
+    EXPECT_EQ(300, mmz->cycles());
+    run(300);
+    EXPECT_EQ(expected, traces());
+}
+
+// Every prefix of a checkpoint is rejected
+// @author   Diesel
+TEST_F(CheckpointTest, TruncatedRejected){
+    std::string data = saved(300);
+    for (size_t n = 0; n < data.size(); n++) {
+        SCOPED_TRACE(n);
+        testrejected(data.substr(0, n));
+    }
+}
+
+// @author   Diesel
+TEST_F(CheckpointTest, BadMagicRejected){
+    std::string data = saved(10);
+    data[0] = 'X';
+    testrejected(data);
+    testrejected("");
+    testrejected("MCK");
+}
+
+// Counters whose last byte is missing, or which never end
+// @author   Diesel
+TEST_F(CheckpointTest, VarintPastEndRejected){
+    std::string data = saved(10);
+    std::string magic = data.substr(0, 4);
+    testrejected(magic + "\x80");
+    testrejected(magic + "\xff\xff\xff");
+    testrejected(magic + std::string(12, '\xff') + data.substr(4));
+}
+
+// Checkpoints of a network with the same number of devices and signals, but
+// wired differently, or with other clock settings
+// @author   Diesel
+TEST_F(CheckpointTest, OtherNetworkRejected){
+    std::string data = saved(10);
+    redefine("I1 : FF.Q;", "I1 : FF.QBAR;");
+    testrejected(data);
+
+    data = saved(10);
+    redefine("Period : 3;", "Period : 4;");
+    testrejected(data);
+
+    data = saved(10);
+    redefine("$0110100", "$0110101");
+    testrejected(data);
+
+    data = saved(10);
+    redefine("$0110101", "$01101010");
+    testrejected(data);
+}
+
+// A clock counts up to its period, and a stream with a counter past it is
+// rejected, as the clock would never tick
+// @author   Diesel
+TEST_F(CheckpointTest, CounterPastPeriodRejected){
+    const simkernel& kern = dmz->getkernel();
+    devstate s;
+    checkpoint cp;
+    std::ostringstream os;
+    run(10);
+    dmz->getstate(s);
+    for (int i = 0; i < kern.devcount(); i++) {
+        if (kern.kind[i] == aclock)
+            s.counter[i] = kern.dev[i]->frequency + 1;
+    }
+    dmz->swapstate(s);
+    cp.take(dmz, mmz, 10);
+    ASSERT_TRUE(cp.write(dmz, os));
+    testrejected(os.str());
+}
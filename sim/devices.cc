@@ -1,6 +1,9 @@
 
 #include <iostream>
+#include <algorithm>
 #include <string>
+#include <unordered_map>
+#include <chrono>
 #include "../com/localestrings.h"
 #include "../com/names.h"
 #include "importeddevice.h"
@@ -8,6 +11,67 @@
 
 using namespace std;
 
+
+/** Bitset helpers for the event engine worklists.
+ */
+static inline void setbit (std::vector<unsigned long long>& b, int i)
+{
+  b[i >> 6] |= 1ULL << (i & 63);
+}
+
+
+/** Returns the hash key of a signal having a value. Changing a signal XORs
+ *  out the key of its old value and in that of its new one, so the hash of
+ *  the signals is kept up to date one change at a time.
+ */
+static inline uint64_t sigkey (size_t g, asignal v)
+{
+  uint64_t z = (((uint64_t) g << 3) | v) + 0x9e3779b97f4a7c15ULL;
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+
+/** Returns the level a signal is moving to, used for gate inputs by the
+ *  levelized engine. Devices in a loop read their inputs as they are, as
+ *  with the sweep engine, see simkernel::levelize.
+ */
+static inline asignal settled (asignal s)
+{
+  if (s == rising) return high;
+  if (s == falling) return low;
+  return s;
+}
+
+/** Initialises an empty state.
+ *
+ * @author Diesel
+ */
+devstate::devstate ()
+{
+  revision = -1;
+  engine = sweepengine;
+  ready = false;
+  steadystate = true;
+  quiet = false;
+  sighash = 0;
+  result = steadycycle;
+}
+
+
+/** Initialises the options to those the simulator has always used.
+ *
+ * @author Diesel
+ */
+settleoptions::settleoptions ()
+{
+  limit = maxmachinecycles;
+  criterion = steadyconverge;
+  policy = abortpolicy;
+}
+
+
 /** Used to print out signal values for debugging in showdevice.
  *
  * @author Gee
@@ -30,24 +94,25 @@ void devices::outsig (asignal s)
  *
  * @author Gee
  */
-void devices::showdevice (devlink d)
+void devices::showdevice (const devstate& s, int i)
 {
-  inplink  i;
+  devlink d = kernel.dev[i];
+  inplink  il;
   outplink o;
   cout << "   " << t("Device") << ": " << nmz->namestr(d->id);
   cout << "   " << t("Kind") << ": ";
   writedevice (d->kind);
   cout << endl;
   cout << "   " << t("Inputs") << ":" << endl;
-  for (i = d->ilist; i != NULL; i = i->next) {
-    cout << "      " << nmz->namestr(i->id) << " ";
-    outsig (i->connect->sig);
+  for (il = d->ilist; il != NULL; il = il->next) {
+    cout << "      " << nmz->namestr(il->id) << " ";
+    outsig (getsignal (s, il->connect));
     cout << endl;
   }
   cout << "   " << t("Outputs") << ":";
   for (o = d->olist; o != NULL; o = o->next) {
     cout << "      " << nmz->namestr(o->id) << " ";
-    outsig (o->sig);
+    outsig (getsignal (s, o));
     cout << endl;
   }
   cout << endl;
@@ -69,11 +134,31 @@ void devices::setswitch (name sid, asignal level, bool& ok, SourcePos at)
     if (ok) {
       d->swstate = level;
       d->setAt = at;
+      if (d->index >= 0 && d->index < (int) state.memory.size ()) {
+        state.memory[d->index] = level;
+        state.quiet = false;
+      }
     }
   }
 }
 
 
+/** Sets the named switch in a simulation state only.
+ *
+ * @author Diesel
+ */
+void devices::setswitch (devstate& s, name sid, asignal level, bool& ok)
+{
+  devlink d = netz->finddevice (sid);
+  ok = (d != NULL && d->kind == aswitch);
+  if (ok) {
+    ensurestate (s);
+    s.memory[d->index] = level;
+    s.quiet = false;
+  }
+}
+
+
 /** Used to make new imported devices.
  *  Called by makedevice().
  *
@@ -90,18 +175,147 @@ void devices::makeimported(name id, std::string fname, errorcollector& errs, Sou
 
   d->definedAt = at;
 
-  d->device = new importeddevice(nmz, errs);
-  d->device->scanAndParse(fname);
+  if (imports == NULL)
+    imports = ownimports = new importcache(nmz);
+  std::shared_ptr<importedmodule> mod = imports->load(fname, errs);
+  mod->dmz->setengine(engine);
+  mod->dmz->setsettle(settle);
+  d->device = new importeddevice(mod);
 
   // Add inputs
-  for (auto inp : d->device->inputs) {
+  for (auto inp : d->device->module->inputs) {
     netz->addinput(d, inp->id, inp->definedAt);
   }
 
   // Add outputs
-  for (auto outp : d->device->outputs) {
+  for (auto& outp : d->device->module->outputs) {
     netz->addoutput(d, outp.first, outp.second->definedAt);
   }
+
+  d->device->bindports(d);
+}
+
+
+/** Replaces imported device d with copies of the devices in its network.
+ *  Called by flatten.
+ *
+ *  Every switch in an imported network is either an input or one of the
+ *  constant 0 and 1 switches, so instead of being copied, whatever they
+ *  drive reads the signal connected to the input pin of d, or our own
+ *  constants. Any outputs of d which are not driven by a copied device, e.g.
+ *  an input monitored as an output, are driven through a one input OR gate.
+ *
+ * @author Diesel
+ */
+void devices::inlinedevice (devlink d)
+{
+  importedmodule* mod = d->device->module.get ();
+  network* sub = mod->netz;
+  namestring prefix = nmz->namestr (d->id) + ".";
+  std::unordered_map<devlink, devlink> copies;        // devices of sub to their copies
+  std::unordered_map<outplink, outplink> outs;        // outputs of sub to ours
+  std::unordered_map<outplink, outplink> exported;    // outputs of sub to outputs of d
+  std::vector<inplink> ins;
+  std::vector<outplink> ols;
+  devlink md, c;
+  inplink il;
+  outplink o;
+  bool ok;
+
+  for (devlink sw : mod->inputs) {
+    il = netz->findinput (d, sw->id);
+    outs[sw->olist] = il ? il->connect : NULL;
+  }
+  for (name rail : {zero, one})
+    outs[sub->findoutput (sub->finddevice (rail), blankname)] =
+      netz->findoutput (netz->finddevice (rail), blankname);
+  for (auto& it : mod->outputs)
+    exported[it.second] = netz->findoutput (d, it.first);
+
+  // Copy the devices, keeping the order of their pins
+  for (md = sub->devicelist (); md != NULL; md = md->next) {
+    if (md->kind == aswitch)
+      continue;
+    netz->adddevice (md->kind, nmz->lookup (prefix + nmz->namestr (md->id)), c, md->definedAt);
+    c->setAt = md->setAt;
+    c->frequency = md->frequency;
+    c->bitstr = md->bitstr;
+    c->device = (md->kind == imported) ? new importeddevice (md->device->module) : NULL;
+
+    ins.clear ();
+    for (il = md->ilist; il != NULL; il = il->next)
+      ins.push_back (il);
+    for (auto it = ins.rbegin (); it != ins.rend (); ++it)
+      netz->addinput (c, (*it)->id, (*it)->definedAt);
+
+    ols.clear ();
+    for (o = md->olist; o != NULL; o = o->next)
+      ols.push_back (o);
+    for (auto it = ols.rbegin (); it != ols.rend (); ++it) {
+      o = *it;
+      if (exported.count (o) && exported[o] != NULL) {
+        netz->moveoutput (exported[o], c, o->id);
+        exported[o] = NULL;
+      }
+      else
+        netz->addoutput (c, o->id, o->definedAt);
+      outs[o] = c->olist;
+    }
+    copies[md] = c;
+  }
+
+  for (auto& it : copies) {
+    if (it.second->kind == imported)
+      it.second->device->bindports (it.second);
+  }
+
+  // Connect the copies as the originals are connected
+  for (auto& it : copies) {
+    for (il = it.first->ilist; il != NULL; il = il->next) {
+      o = (il->connect != NULL) ? outs[il->connect] : NULL;
+      if (o != NULL)
+        netz->makeconnection (it.second->id, il->id, netz->findoutputdevice (o)->id, o->id, ok);
+    }
+  }
+
+  // Drive what is left of d through buffers
+  while (d->olist != NULL) {
+    o = d->olist;
+    netz->adddevice (orgate, nmz->lookup (prefix + nmz->namestr (o->id)), c, o->definedAt);
+    netz->addinput (c, nmz->lookup ("I1"));
+    for (auto& it : mod->outputs) {
+      if (it.first == o->id && outs[it.second] != NULL)
+        netz->makeconnection (c->id, nmz->lookup ("I1"),
+                              netz->findoutputdevice (outs[it.second])->id, outs[it.second]->id, ok);
+    }
+    netz->moveoutput (o, c, blankname);
+  }
+
+  netz->removedevice (d);
+}
+
+
+/** Replaces every imported device with copies of the devices in its network.
+ *
+ * @author Diesel
+ */
+void devices::flatten (void)
+{
+  devlink d, next;
+  bool found = true;
+  // copies of devices imported by imported devices are added as we go
+  while (found) {
+    found = false;
+    for (d = netz->devicelist (); d != NULL; d = next) {
+      next = d->next;
+      if (d->kind == imported) {
+        inlinedevice (d);
+        found = true;
+      }
+    }
+  }
+  compile ();
+  resetdevices ();
 }
 
 
@@ -167,7 +381,6 @@ void devices::makesiggen(name id, std::vector<bool> bits, int period, bool& ok,
   if (ok) {
     d->definedAt = at;
     netz->addoutput (d, blankname);
-    d->bitstrpos = 0;
     d->bitstr = bits;
     d->frequency = period;
   }
@@ -205,7 +418,6 @@ void devices::makeclock (name id, int frequency, SourcePos at)
   netz->addoutput (d, blankname);
   d->definedAt = at;
   d->frequency = frequency;
-  d->counter = 0;
 }
 
 
@@ -255,7 +467,6 @@ void devices::makedtype (name id, bool& ok, SourcePos at)
   netz->addinput (d, clkpin);
   netz->addoutput (d, qpin);
   netz->addoutput (d, qbarpin);
-  d->memory = low;
   d->definedAt = at;
 }
 
@@ -308,16 +519,19 @@ void devices::makedevice (devicekind dkind, name did, int variant, bool& ok, Sou
 
 
 /** Update signal `sig' in the direction of signal `target'.
- *  Set steadystate to false if this results in a change in sig.
+ *  Set the steadystate of s to false if this results in a change in sig.
  *
  * @author Gee
  */
-void devices::signalupdate (asignal target, asignal& sig)
+void devices::signalupdate (devstate& s, asignal target, asignal& sig)
 {
   if (target == indet) {
     if (sig != indet) {
+      s.sighash ^= sigkey (&sig - s.sig.data (), sig) ^ sigkey (&sig - s.sig.data (), indet);
       sig = indet;
-      steadystate = false;
+      s.steadystate = false;
+      if (stats)
+        stats->changes++;
     }
     return;
   }
@@ -341,8 +555,12 @@ void devices::signalupdate (asignal target, asignal& sig)
       sig = target;
       break;
   }
-  if (sig != oldsig)
-    steadystate = false;
+  if (sig != oldsig) {
+    s.sighash ^= sigkey (&sig - s.sig.data (), oldsig) ^ sigkey (&sig - s.sig.data (), sig);
+    s.steadystate = false;
+    if (stats)
+      stats->changes++;
+  }
 }
 
 
@@ -362,37 +580,33 @@ asignal devices::inv (asignal s)
  *
  * @author Gee
  */
-void devices::execswitch (devlink d)
+void devices::execswitch (devstate& s, int i)
 {
-  signalupdate (d->swstate, d->olist->sig);
+  signalupdate (s, s.memory[i], s.sig[kernel.outbegin[i]]);
 }
 
 
 /** Used to simulate the operation of select devices.
+ *  Inputs are SW, HIGH, LOW, see simkernel.
  *  Called by executedevices.
  *
  * @author Diesel
  */
-void devices::execselect (devlink d, bool& ok)
+void devices::execselect (devstate& s, int i)
 {
-  inplink il = netz->findinput(d, swpin);
-  ok = il;
-  if (ok) {
-    inplink conil;
-    if (il->connect->sig == high)
-      conil = netz->findinput(d, highpin);
-    else if (il->connect->sig == indet) {
-      signalupdate(indet, d->olist->sig);
-      return;
-    }
-    else
-      conil = netz->findinput(d, lowpin);
-
-    ok = conil;
-    if (ok) {
-      signalupdate(conil->connect->sig, d->olist->sig);
-    }
-  }
+  const int32_t* in = &kernel.insig[kernel.inbegin[i]];
+  asignal sw = s.sig[in[selsw]];
+  asignal& out = s.sig[kernel.outbegin[i]];
+  bool settle = settleinputs && !kernel.cyclic[i];
+  if (settle)
+    sw = settled (sw);
+
+  if (sw == high)
+    signalupdate (s, settle ? settled (s.sig[in[selhigh]]) : s.sig[in[selhigh]], out);
+  else if (sw == indet)
+    signalupdate (s, indet, out);
+  else
+    signalupdate (s, settle ? settled (s.sig[in[sellow]]) : s.sig[in[sellow]], out);
 }
 
 
@@ -401,13 +615,14 @@ void devices::execselect (devlink d, bool& ok)
  *
  * @author Diesel
  */
-void devices::execsiggen(devlink d)
+void devices::execsiggen(devstate& s, int i)
 {
-  if (d->olist->sig == rising)
-    signalupdate (high, d->olist->sig);
+  asignal& out = s.sig[kernel.outbegin[i]];
+  if (out == rising)
+    signalupdate (s, high, out);
   else {
-    if (d->olist->sig == falling)
-      signalupdate (low, d->olist->sig);
+    if (out == falling)
+      signalupdate (s, low, out);
   }
 }
 
@@ -418,21 +633,25 @@ void devices::execsiggen(devlink d)
  *
  * @author Gee
  */
-void devices::execgate (devlink d, asignal x, asignal y)
+void devices::execgate (devstate& s, int i, asignal x, asignal y)
 {
   asignal newoutp;
-  inplink inp = d->ilist;
-  outplink outp = d->olist;
+  int32_t k = kernel.inbegin[i];
+  int32_t end = kernel.inbegin[i + 1];
+  bool settle = settleinputs && !kernel.cyclic[i];
   newoutp = y;
-  while ((inp != NULL) && ((newoutp == y) || newoutp == indet)) {
-    if (inp->connect->sig == inv (x))
+  while ((k < end) && ((newoutp == y) || newoutp == indet)) {
+    asignal in = s.sig[kernel.insig[k]];
+    if (settle)
+      in = settled (in);
+    if (in == inv (x))
       newoutp = inv (y);
-    else if (inp->connect->sig == indet)
+    else if (in == indet)
       newoutp = indet;
 
-    inp = inp->next;
+    k++;
   }
-  signalupdate (newoutp, outp->sig);
+  signalupdate (s, newoutp, s.sig[kernel.outbegin[i]]);
 }
 
 
@@ -441,16 +660,22 @@ void devices::execgate (devlink d, asignal x, asignal y)
  *
  * @author Gee
  */
-void devices::execxorgate(devlink d)
+void devices::execxorgate(devstate& s, int i)
 {
   asignal newoutp;
-  if (d->ilist->connect->sig == indet || d->ilist->next->connect->sig == indet)
+  const int32_t* in = &kernel.insig[kernel.inbegin[i]];
+  asignal a = s.sig[in[0]], b = s.sig[in[1]];
+  if (settleinputs && !kernel.cyclic[i]) {
+    a = settled (a);
+    b = settled (b);
+  }
+  if (a == indet || b == indet)
     newoutp = indet;
-  if (d->ilist->connect->sig == d->ilist->next->connect->sig)
+  if (a == b)
     newoutp = low;
   else
     newoutp = high;
-  signalupdate (newoutp, d->olist->sig);
+  signalupdate (s, newoutp, s.sig[kernel.outbegin[i]]);
 }
 
 
@@ -463,45 +688,33 @@ void devices::execxorgate(devlink d)
  *
  * @author Gee
  */
-void devices::execdtype (devlink d)
+void devices::execdtype (devstate& s, int i)
 {
   asignal datainput, clkinput, setinput, clrinput;
-  inplink i;
-  outplink qout, qbarout;
-  i = netz->findinput (d, datapin); datainput = i->connect->sig;
-  i = netz->findinput (d, clkpin);  clkinput  = i->connect->sig;
-
-  // SET and CLEAR default to low if not specified.
-  i = netz->findinput (d, clrpin);
-  if (!i)
-    clrinput = low;
-  else
-    clrinput  = i->connect->sig;
+  asignal& memory = s.memory[i];
 
-  i = netz->findinput (d, setpin);
-  if (!i)
-    setinput = low;
-  else
-    setinput  = i->connect->sig;
-
-
-  qout = netz->findoutput (d, qpin);
-  qbarout = netz->findoutput (d, qbarpin);
+  // Inputs are DATA, CLK, SET, CLEAR, and outputs Q, QBAR, see simkernel.
+  // SET and CLEAR read the constant low signal if not specified.
+  const int32_t* in = &kernel.insig[kernel.inbegin[i]];
+  datainput = s.sig[in[dtdata]];
+  clkinput  = s.sig[in[dtclk]];
+  setinput  = s.sig[in[dtset]];
+  clrinput  = s.sig[in[dtclear]];
 
   if (clkinput == indet || setinput == indet || clrinput == indet)
-    d->memory = indet;
+    memory = indet;
   if ((clkinput == rising) && ((datainput == falling) || (datainput == rising)))
-    d->memory = indet;
+    memory = indet;
   if ((clkinput == rising) && (datainput == high))
-    d->memory = high;
+    memory = high;
   if ((clkinput == rising) && (datainput == low))
-    d->memory = low;
+    memory = low;
   if (setinput == high)
-    d->memory = high;
+    memory = high;
   if (clrinput == high)
-    d->memory = low;
-  signalupdate (d->memory, qout->sig);
-  signalupdate (inv (d->memory), qbarout->sig);
+    memory = low;
+  signalupdate (s, memory, s.sig[kernel.outbegin[i]]);
+  signalupdate (s, inv (memory), s.sig[kernel.outbegin[i] + dtqbar]);
 }
 
 
@@ -510,13 +723,14 @@ void devices::execdtype (devlink d)
  *
  * @author Gee
  */
-void devices::execclock(devlink d)
+void devices::execclock(devstate& s, int i)
 {
-  if (d->olist->sig == rising)
-    signalupdate (high, d->olist->sig);
+  asignal& out = s.sig[kernel.outbegin[i]];
+  if (out == rising)
+    signalupdate (s, high, out);
   else {
-    if (d->olist->sig == falling)
-      signalupdate (low, d->olist->sig);
+    if (out == falling)
+      signalupdate (s, low, out);
   }
 }
 
@@ -524,21 +738,37 @@ void devices::execclock(devlink d)
 /** Used to simulate the operation of an imported network.
  *  Called by executedevices.
  *
+ *  The inputs of the device set the switches of the module's network in the
+ *  device's own state, which is then run for a simulation cycle without
+ *  updating clocks. The module itself is not changed, so it can be shared.
+ *
  * @author Diesel
  */
-void devices::execimported(devlink d) {
-  // Update input pins
-  for (inplink il = d->ilist; il; il = il->next) {
-    d->device->setInput(il->id, il->connect->sig);
+void devices::execimported(devstate& s, int i) {
+  importeddevice* dev = kernel.dev[i]->device;
+  importedmodule* mod = dev->module.get();
+  devstate& sub = s.imported[impslot[i]];
+  bool ok = true;
+
+  mod->dmz->ensurestate(sub);
+
+  // Inputs are stored in list order, as the device's pins were bound
+  const int32_t* in = &kernel.insig[kernel.inbegin[i]];
+  for (unsigned int k = 0; k < dev->inpos.size(); k++) {
+    sub.memory[mod->inputs[dev->inpos[k]]->index] = s.sig[in[k]];
   }
 
-  d->device->execute();
+  // the signals inside are part of the state, for finding oscillations
+  uint64_t h = sub.sighash;
+  mod->dmz->executedevices(sub, ok, false);
+  s.sighash ^= h ^ sub.sighash;
+  if (!ok) {
+    throw mattruntimeerror(t("Imported device network failed to stabilise."), kernel.dev[i]->definedAt);
+  }
 
-  // Update output pins
-  asignal s;
-  for (outplink ol = d->olist; ol; ol = ol->next) {
-    d->device->getOutput(ol->id, s);
-    signalupdate(s, ol->sig);
+  int32_t out = kernel.outbegin[i];
+  for (unsigned int k = 0; k < dev->outpos.size(); k++) {
+    signalupdate(s, sub.sig[mod->outputs[dev->outpos[k]].second->sigid], s.sig[out + k]);
   }
 }
 
@@ -550,41 +780,397 @@ void devices::execimported(devlink d) {
  * @author Gee
  */
 void devices::updateclocks (void)
+{
+  updateclocks (state);
+}
+
+
+/** Updates clocks in a simulation state.
+ *
+ * @author Gee, Diesel
+ */
+void devices::updateclocks (devstate& s)
 {
   devlink d;
-  for (d = netz->devicelist (); d != NULL; d = d->next) {
-    if (d->kind == aclock) {
-      if (d->counter == d->frequency) {
-        d->counter = 0;
-        if (d->olist->sig == high)
-          d->olist->sig = falling;
+  ensurestate (s);
+  for (int i : clockdevs) {
+    d = kernel.dev[i];
+    if (kernel.kind[i] == aclock) {
+      if (s.counter[i] == d->frequency) {
+        asignal& out = s.sig[kernel.outbegin[i]];
+        s.counter[i] = 0;
+        if (out == high)
+          out = falling;
         else
-          d->olist->sig = rising;
+          out = rising;
+        markoutput (s, i);
+        s.quiet = false;
       }
-      (d->counter)++;
+      s.counter[i]++;
     }
-    else if (d->kind == imported) {
-      d->device->tick();
+    else if (kernel.kind[i] == imported) {
+      d->device->module->dmz->updateclocks (s.imported[impslot[i]]);
     }
-    else if (d->kind == siggen) {
-      if (d->frequency == 0 || d->counter == d->frequency) {
-        d->counter = 0;
-        if (++(d->bitstrpos) >= d->bitstr.size()) {
-          d->bitstrpos = 0;
+    else if (kernel.kind[i] == siggen) {
+      if (d->frequency == 0 || s.counter[i] == d->frequency) {
+        asignal& out = s.sig[kernel.outbegin[i]];
+        s.counter[i] = 0;
+        if (++(s.bitstrpos[i]) >= (int) d->bitstr.size()) {
+          s.bitstrpos[i] = 0;
         }
 
-        asignal newSig = d->bitstr[d->bitstrpos] ? high : low;
-        if (newSig != d->olist->sig) {
-          signalupdate(newSig, d->olist->sig);
+        asignal newSig = d->bitstr[s.bitstrpos[i]] ? high : low;
+        if (newSig != out) {
+          signalupdate(s, newSig, out);
+          markoutput (s, i);
+          s.quiet = false;
         }
 
       }
-      (d->counter)++;
+      s.counter[i]++;
     }
   }
 }
 
 
+/** Runs a single device. Called by executesweep and executeevents.
+ *
+ * @author Gee
+ */
+void devices::execdevice (devstate& s, int i, bool& ok)
+{
+  switch (kernel.kind[i]) {
+    case aswitch:  execswitch (s, i);           break;
+    case aclock:   execclock (s, i);            break;
+    case orgate:   execgate (s, i, low, low);   break;
+    case norgate:  execgate (s, i, low, high);  break;
+    case andgate:  execgate (s, i, high, high); break;
+    case nandgate: execgate (s, i, high, low);  break;
+    case xorgate:  execxorgate (s, i);          break;
+    case dtype:    execdtype (s, i);            break;
+    case aselect:  execselect (s, i);           break;
+    case imported: execimported (s, i);         break;
+    case siggen:   execsiggen (s, i);           break;
+    default:       ok = false;                  break;
+  }
+  if (stats)
+    stats->evals[kernel.kind[i]]++;
+  if (debugging)
+    showdevice (s, i);
+}
+
+
+/** Runs one machine cycle by executing every device in list order.
+ *
+ * @author Gee
+ */
+void devices::executesweep (devstate& s, bool& ok)
+{
+  int i, n = kernel.devcount ();
+  for (i = 0; i < n; i++)
+    execdevice (s, i, ok);
+}
+
+
+/** Runs one machine cycle, executing only the devices queued in evnext.
+ *
+ *  Devices are taken in evorder, which for the event engine is list order, so
+ *  this visits the same devices in the same order as executesweep, skipping
+ *  those whose inputs and outputs have not changed since they were last
+ *  executed (and so would not change). When a device changes an output, the
+ *  devices it fans out to are queued: later in evorder they run in this
+ *  machine cycle, otherwise in the next. The device itself is queued for the
+ *  next cycle to settle rising/falling.
+ *
+ * @author Diesel
+ */
+void devices::executeevents (devstate& s, bool& ok)
+{
+  unsigned int w;
+  int p, i, g, f, q, first, last;
+  std::vector<unsigned long long>& evcur = s.evcur;
+  std::vector<unsigned long long>& evnext = s.evnext;
+
+  evcur.swap (evnext);
+  std::fill (evnext.begin (), evnext.end (), 0ULL);
+
+  for (w = 0; w < evcur.size (); w++) {
+    // evcur[w] is re-read each time, as devices later in this word may be queued
+    while (evcur[w]) {
+      p = w * 64 + __builtin_ctzll (evcur[w]);
+      evcur[w] &= evcur[w] - 1;
+      i = evorder[p];
+      first = kernel.outbegin[i];
+      last = kernel.outbegin[i + 1];
+
+      s.evold.assign (s.sig.begin () + first, s.sig.begin () + last);
+
+      execdevice (s, i, ok);
+
+      for (g = first; g < last; g++) {
+        if (s.sig[g] != s.evold[g - first]) {
+          setbit (evnext, p);
+          for (f = kernel.fobegin[g]; f < kernel.fobegin[g + 1]; f++) {
+            q = evslot[kernel.fanout[f]];
+            setbit ((q > p) ? evcur : evnext, q);
+          }
+        }
+      }
+    }
+  }
+}
+
+
+/** Compiles the network if it has changed since it was last compiled.
+ *
+ * @author Diesel
+ */
+void devices::ensurecompiled (void)
+{
+  if (kernel.revision != netz->revision ())
+    compile ();
+}
+
+
+/** Compiles the network if needed, and replaces s with a copy of the current
+ *  state if it is not a state of the compiled network.
+ *
+ * @author Diesel
+ */
+void devices::ensurestate (devstate& s)
+{
+  ensurecompiled ();
+  if (s.revision != kernel.revision)
+    s = state;
+}
+
+
+/** Carries a state over to a new compilation of the network, using the
+ *  previous numbers of devices and signals kept by simkernel::build. New
+ *  devices start as they were made, and new imported devices from the
+ *  current state of their module.
+ *
+ * @author Diesel
+ */
+void devices::carrystate (devstate& s, const std::vector<int32_t>& oldslot)
+{
+  devstate old;
+  int i, g, p, n = kernel.devcount ();
+  std::swap (old, s);
+
+  s.sig.assign (kernel.sigcount (), low);
+  for (g = 0; g < kernel.sigcount (); g++) {
+    p = kernel.oldsig[g];
+    if (p >= 0 && p < (int) old.sig.size ())
+      s.sig[g] = old.sig[p];
+  }
+
+  s.memory.assign (n, low);
+  s.counter.assign (n, 0);
+  s.bitstrpos.assign (n, 0);
+  for (i = 0; i < n; i++) {
+    devlink d = kernel.dev[i];
+    p = kernel.olddev[i];
+    bool had = (p >= 0 && p < (int) old.memory.size ());
+    switch (kernel.kind[i]) {
+      case aswitch:  s.memory[i] = had ? old.memory[p] : d->swstate; break;
+      case dtype:    s.memory[i] = had ? old.memory[p] : low;        break;
+      case aclock:   s.counter[i] = had ? old.counter[p] : 0;        break;
+      case siggen:   s.counter[i] = had ? old.counter[p] : 0;
+                     s.bitstrpos[i] = had ? old.bitstrpos[p] : 0;    break;
+      case imported:
+        s.imported.push_back (devstate ());
+        if (had && p < (int) oldslot.size () && oldslot[p] >= 0)
+          std::swap (s.imported.back (), old.imported[oldslot[p]]);
+        else
+          d->device->module->dmz->getstate (s.imported.back ());
+        break;
+      default:                                                       break;
+    }
+  }
+  s.revision = kernel.revision;
+  s.ready = false;
+  s.steadystate = true;
+  s.quiet = false;
+}
+
+
+/** Looks up the fixed pins of every DTYPE and SELECT device once, and stores
+ *  them in devicerec::pin and devicerec::opin so evaluation never searches
+ *  pins by name. Pins which are not defined are left NULL.
+ *
+ * @author Diesel
+ */
+void devices::resolvepins (void)
+{
+  for (devlink d = netz->devicelist (); d != NULL; d = d->next) {
+    if (d->kind == dtype) {
+      d->pin[dtdata] = netz->findinput (d, datapin);
+      d->pin[dtclk] = netz->findinput (d, clkpin);
+      d->pin[dtset] = netz->findinput (d, setpin);
+      d->pin[dtclear] = netz->findinput (d, clrpin);
+      d->opin[dtq] = netz->findoutput (d, qpin);
+      d->opin[dtqbar] = netz->findoutput (d, qbarpin);
+    }
+    else if (d->kind == aselect) {
+      d->pin[selsw] = netz->findinput (d, swpin);
+      d->pin[selhigh] = netz->findinput (d, highpin);
+      d->pin[sellow] = netz->findinput (d, lowpin);
+    }
+  }
+}
+
+
+/** Compiles the network into the flat form used by the simulator, and
+ *  carries our own state over to it.
+ *
+ * @author Diesel
+ */
+void devices::compile (void)
+{
+  std::vector<int32_t> oldslot;
+  oldslot.swap (impslot);
+  resolvepins ();
+  kernel.build (netz);
+
+  int k = 0;
+  impslot.assign (kernel.devcount (), -1);
+  clockdevs.clear ();
+  for (int i = 0; i < kernel.devcount (); i++) {
+    if (kernel.kind[i] == imported)
+      impslot[i] = k++;
+    if (kernel.kind[i] == aclock || kernel.kind[i] == siggen || kernel.kind[i] == imported)
+      clockdevs.push_back (i);
+  }
+  prepareevents ();
+  carrystate (state, oldslot);
+}
+
+
+/** Returns the current value of a device output.
+ *
+ * @author Diesel
+ */
+asignal devices::getsignal (outplink o) const
+{
+  return getsignal (state, o);
+}
+
+
+/** Returns the value of a device output in a simulation state.
+ *
+ * @author Diesel
+ */
+asignal devices::getsignal (const devstate& s, outplink o) const
+{
+  if (o->sigid < 0 || o->sigid >= (int) s.sig.size () || s.revision != kernel.revision)
+    return low;
+  return s.sig[o->sigid];
+}
+
+
+/** Copies the simulation state of the network.
+ *
+ * @author Diesel
+ */
+void devices::getstate (devstate& s)
+{
+  ensurecompiled ();
+  s = state;
+}
+
+
+/** Exchanges the simulation state of the network with s.
+ *
+ * @author Diesel
+ */
+void devices::swapstate (devstate& s)
+{
+  ensurecompiled ();
+  if (s.revision == kernel.revision)
+    std::swap (state, s);
+  else
+    s = state;
+}
+
+
+/** Shares a cache of imported files with this network.
+ *
+ * @author Diesel
+ */
+void devices::setimportcache (importcache* cache)
+{
+  imports = cache;
+}
+
+
+/** Returns the compiled network.
+ *
+ * @author Diesel
+ */
+const simkernel& devices::getkernel (void)
+{
+  ensurecompiled ();
+  return kernel;
+}
+
+
+/** Sets up the evaluation order of the event and levelized engines for the
+ *  kernel. This is done as soon as the kernel or engine changes, so the
+ *  order is only read while states are simulated.
+ *
+ * @author Diesel
+ */
+void devices::prepareevents (void)
+{
+  int i, n = kernel.devcount ();
+  if (engine == levelizedengine) {
+    evorder = kernel.order;
+    evslot = kernel.rank;
+  }
+  else {
+    evorder.resize (n);
+    for (i = 0; i < n; i++)
+      evorder[i] = i;
+    evslot = evorder;
+  }
+
+  // switches can be set directly by imported devices, and imported devices
+  // have their own clocks, so these are always executed.
+  evalways.clear ();
+  for (i = 0; i < n; i++) {
+    if (kernel.kind[i] == aswitch || kernel.kind[i] == imported)
+      evalways.push_back (evslot[i]);
+  }
+}
+
+
+/** Returns true if the event worklists of s are valid for the engine.
+ *
+ * @author Diesel
+ */
+bool devices::evready (const devstate& s) const
+{
+  return s.ready && s.engine == engine;
+}
+
+
+/** Queues device i and everything connected to its outputs, after they have
+ *  been changed outside of executedevices.
+ *
+ * @author Diesel
+ */
+void devices::markoutput (devstate& s, int i)
+{
+  if (engine != sweepengine && evready (s)) {
+    setbit (s.pending, evslot[i]);
+    for (int g = kernel.outbegin[i]; g < kernel.outbegin[i + 1]; g++)
+      for (int f = kernel.fobegin[g]; f < kernel.fobegin[g + 1]; f++)
+        setbit (s.pending, evslot[kernel.fanout[f]]);
+  }
+}
+
+
 /** Executes all devices in the network to simulate one complete clock
  *  cycle.
  *
@@ -592,41 +1178,329 @@ void devices::updateclocks (void)
  */
 void devices::executedevices (bool& ok, bool tick)
 {
-  const int maxmachinecycles = 20;
-  devlink d;
-  int machinecycle;
+  executedevices (state, ok, tick);
+}
+
+
+/** Simulates one complete clock cycle of a simulation state.
+ *
+ * @author Gee, Diesel
+ */
+void devices::executedevices (devstate& s, bool& ok, bool tick)
+{
+  typedef std::chrono::steady_clock clock;
+  clock::time_point t0, t1;
+  long long changes = 0;
+  int machinecycle, period = 0;
+  bool converged;
+  ensurestate (s);
+  if (engine != sweepengine && !evready (s)) {
+    // queue every device
+    int i, n = kernel.devcount ();
+    int words = (n + 63) / 64;
+    s.evcur.assign (words, 0ULL);
+    s.evnext.assign (words, 0ULL);
+    s.pending.assign (words, 0ULL);
+    for (i = 0; i < n; i++)
+      setbit (s.pending, i);
+    s.engine = engine;
+    s.ready = true;
+  }
   if (debugging)
     cout << t("Start of execution cycle") << endl;
+  if (stats) {
+    t0 = clock::now ();
+    changes = stats->changes;
+  }
   if (tick)
-    updateclocks ();
-  machinecycle = 0;
+    updateclocks (s);
+  if (stats)
+    t1 = clock::now ();
+  if (engine != sweepengine) {
+    s.evnext.swap (s.pending);
+    std::fill (s.pending.begin (), s.pending.end (), 0ULL);
+    for (int i : evalways)
+      setbit (s.evnext, i);
+  }
+  s.looping.clear ();
+  machinecycle = runmachinecycles (s, ok, period);
+  if (s.steadystate)
+    s.result = steadycycle;
+  else if (period > 0)
+    s.result = (settle.criterion == periodicconverge) ? periodiccycle : oscillatingcycle;
+  else
+    s.result = limitcycle;
+  converged = (s.result == steadycycle || s.result == periodiccycle);
+
+  // find the devices still changing, unless giving up on the cycle anyway
+  if (period > 0)
+    findloop (s, period, ok);
+  else if (! converged && settle.policy != abortpolicy)
+    findloop (s, 1, ok);
+  if (! converged && settle.policy == indetpolicy) {
+    if (debugging)
+      cout << t("Outputs still changing set to indet") << endl;
+    markindet (s);
+    machinecycle += runmachinecycles (s, ok, period);
+  }
+  if (debugging)
+    cout << t("End of execution cycle") << endl;
+  if (stats) {
+    clock::time_point t2 = clock::now ();
+    stats->clocktime += std::chrono::duration<double> (t1 - t0).count ();
+    stats->devicetime += std::chrono::duration<double> (t2 - t1).count ();
+    stats->maxchanges = std::max (stats->maxchanges, stats->changes - changes);
+    stats->addcycle (machinecycle, converged);
+  }
+  if (! s.steadystate)
+    s.ready = false;  // start again from a full sweep
+  s.quiet = s.steadystate;
+  ok = converged || settle.policy != abortpolicy;
+}
+
+
+/** Runs machine cycles until one changes no signal, the signals repeat
+ *  those after an earlier machine cycle, or the settle limit is reached.
+ *
+ * @param      period  Returns the number of machine cycles in the loop
+ *                     found, or 0 if the signals did not repeat.
+ * @return     The number of machine cycles run.
+ *
+ * @author Diesel
+ */
+int devices::runmachinecycles (devstate& s, bool& ok, int& period)
+{
+  int machinecycle = 0;
+  period = 0;
+  s.seen.assign (1, s.sighash);
   do {
     machinecycle++;
     if (debugging)
       cout << t("machine cycle") << " # " << machinecycle << endl;
-    steadystate = true;
-    for (d = netz->devicelist (); d != NULL; d = d->next) {
-      switch (d->kind) {
-        case aswitch:  execswitch (d);           break;
-        case aclock:   execclock (d);            break;
-        case orgate:   execgate (d, low, low);   break;
-        case norgate:  execgate (d, low, high);  break;
-        case andgate:  execgate (d, high, high); break;
-        case nandgate: execgate (d, high, low);  break;
-        case xorgate:  execxorgate (d);          break;
-        case dtype:    execdtype (d);            break;
-        case aselect:  execselect(d, ok);        break;
-        case imported: execimported(d);          break;
-        case siggen:   execsiggen(d);            break;
-        default:       ok = false;               break;
+    runmachinecycle (s, ok);
+    if (! s.steadystate)
+      period = repeated (s);
+  } while ((! s.steadystate) && (machinecycle < settle.limit) && (period == 0));
+  return machinecycle;
+}
+
+
+/** Runs one machine cycle with the current engine.
+ *
+ * @author Diesel
+ */
+void devices::runmachinecycle (devstate& s, bool& ok)
+{
+  s.steadystate = true;
+  if (engine != sweepengine)
+    executeevents (s, ok);
+  else
+    executesweep (s, ok);
+}
+
+
+/** Checks whether the signals after a machine cycle are the same as after
+ *  an earlier machine cycle of this cycle. As the next machine cycle only
+ *  depends on the signals, the network will then go round the same loop
+ *  for ever rather than settle. Only the last maxperiod machine cycles are
+ *  compared, so large settle limits stay cheap, and longer loops simply
+ *  run to the limit.
+ *
+ * @return     The number of machine cycles in the loop, or 0 if the signals
+ *             have not been seen before.
+ *
+ * @author Diesel
+ */
+int devices::repeated (devstate& s)
+{
+  int first = std::max (0, (int) s.seen.size () - maxperiod);
+  for (int k = s.seen.size () - 1; k >= first; k--) {
+    if (s.seen[k] == s.sighash)
+      return s.seen.size () - k;
+  }
+  s.seen.push_back (s.sighash);
+  return 0;
+}
+
+
+/** Goes round an oscillation once more, noting the devices whose outputs
+ *  change, see oscillating. With a period of 1, this finds the devices
+ *  still changing when the settle limit was reached.
+ *
+ * @author Diesel
+ */
+void devices::findloop (devstate& s, int period, bool& ok)
+{
+  std::vector<asignal> old;
+  std::vector<bool> changed (kernel.devcount (), false);
+  for (int k = 0; k < period; k++) {
+    old = s.sig;
+    runmachinecycle (s, ok);
+    for (int g = 0; g < kernel.outbegin[kernel.devcount ()]; g++) {
+      if (s.sig[g] != old[g]) {
+        int i = std::upper_bound (kernel.outbegin.begin (), kernel.outbegin.end (), g)
+                - kernel.outbegin.begin () - 1;
+        changed[i] = true;
       }
-      if (debugging)
-        showdevice (d);
     }
-  } while ((! steadystate) && (machinecycle < maxmachinecycles));
-  if (debugging)
-    cout << t("End of execution cycle") << endl;
-  ok = steadystate;
+  }
+  for (int i = 0; i < kernel.devcount (); i++) {
+    if (changed[i])
+      s.looping.push_back (i);
+  }
+  s.steadystate = false;
+}
+
+
+/** Sets the outputs of the devices found still changing to indet, for
+ *  indetpolicy, and queues the devices they feed for the event engine.
+ *  Switches, clocks and signal generators are left alone, as they would
+ *  never leave indet again.
+ *
+ * @author Diesel
+ */
+void devices::markindet (devstate& s)
+{
+  for (int i : s.looping) {
+    devicekind k = kernel.kind[i];
+    if (k == aswitch || k == aclock || k == siggen)
+      continue;
+    for (int g = kernel.outbegin[i]; g < kernel.outbegin[i + 1]; g++) {
+      signalupdate (s, indet, s.sig[g]);
+      if (engine == sweepengine)
+        continue;
+      setbit (s.evnext, evslot[i]);
+      for (int f = kernel.fobegin[g]; f < kernel.fobegin[g + 1]; f++)
+        setbit (s.evnext, evslot[kernel.fanout[f]]);
+    }
+  }
+}
+
+
+/** Returns how the last cycle executed ended.
+ *
+ * @author Diesel
+ */
+cycleresult devices::lastcycle (void)
+{
+  return lastcycle (state);
+}
+
+
+/** Returns how the last cycle executed in a simulation state ended.
+ *
+ * @author Diesel
+ */
+cycleresult devices::lastcycle (const devstate& s)
+{
+  if (s.revision != kernel.revision)
+    return steadycycle;
+  return s.result;
+}
+
+
+/** Returns the devices which were found to oscillate.
+ *
+ * @author Diesel
+ */
+void devices::oscillating (std::vector<devlink>& devs)
+{
+  oscillating (state, devs);
+}
+
+
+/** Returns the devices which were found to oscillate in a simulation state.
+ *
+ * @author Diesel
+ */
+void devices::oscillating (const devstate& s, std::vector<devlink>& devs)
+{
+  devs.clear ();
+  if (s.revision != kernel.revision)
+    return;
+  for (int i : s.looping)
+    devs.push_back (kernel.dev[i]);
+}
+
+
+/** Returns how many of the next cycles, up to limit, no CLOCK or SIGGEN in
+ *  s or its imported devices changes in. A clock changes when its counter
+ *  reaches its period, so never once it has passed it.
+ *
+ * @author Diesel
+ */
+int devices::horizon (const devstate& s, int limit) const
+{
+  for (int i : clockdevs) {
+    devlink d = kernel.dev[i];
+    switch (kernel.kind[i]) {
+      case siggen:
+        if (d->frequency == 0)
+          return 0;
+        if (s.counter[i] <= d->frequency)
+          limit = std::min (limit, d->frequency - s.counter[i]);
+        break;
+      case aclock:
+        if (s.counter[i] <= d->frequency)
+          limit = std::min (limit, d->frequency - s.counter[i]);
+        break;
+      case imported:
+        if (!s.imported[impslot[i]].quiet)
+          return 0;
+        limit = d->device->module->dmz->horizon (s.imported[impslot[i]], limit);
+        break;
+      default:
+        break;
+    }
+  }
+  return limit;
+}
+
+
+/** Counts the clocks of s and its imported devices on by a number of cycles
+ *  in which none of them change, see horizon.
+ *
+ * @author Diesel
+ */
+void devices::advanceclocks (devstate& s, int ncycles)
+{
+  for (int i : clockdevs) {
+    if (kernel.kind[i] == imported)
+      kernel.dev[i]->device->module->dmz->advanceclocks (s.imported[impslot[i]], ncycles);
+    else
+      s.counter[i] += ncycles;
+  }
+}
+
+
+/** Skips the next cycles in which no CLOCK or SIGGEN changes.
+ *
+ * @author Diesel
+ */
+int devices::skipidle (int maxcycles)
+{
+  return skipidle (state, maxcycles);
+}
+
+
+/** Skips idle cycles of a simulation state.
+ *
+ *  A quiet state is one executedevices left settled, so running a device
+ *  again changes nothing. Until a clock changes, a cycle only counts the
+ *  clocks on and runs the devices, which leaves the state as it is.
+ *
+ * @author Diesel
+ */
+int devices::skipidle (devstate& s, int maxcycles)
+{
+  ensurecompiled ();
+  if (debugging || !s.quiet || s.revision != kernel.revision || maxcycles <= 0)
+    return 0;
+  int n = horizon (s, maxcycles);
+  advanceclocks (s, n);
+  if (stats)
+    stats->skipped += n;
+  return n;
 }
 
 
@@ -635,36 +1509,107 @@ void devices::executedevices (bool& ok, bool tick)
  * @author Diesel
  */
 void devices::resetdevices() {
-  for (devlink d = netz->devicelist(); d; d = d->next) {
-    switch (d->kind) {
+  resetdevices (state);
+}
+
+
+/** Resets devices in a simulation state.
+ *
+ * @author Diesel
+ */
+void devices::resetdevices (devstate& s) {
+  ensurestate (s);
+  for (int i = 0; i < kernel.devcount (); i++) {
+    devlink d = kernel.dev[i];
+    int32_t out = kernel.outbegin[i];
+    switch (kernel.kind[i]) {
       case aclock:
-        d->counter = 0;
+        s.counter[i] = 0;
+        // a clock starts low like the gates
+        // fall through
       case orgate:
       case norgate:
       case andgate:
       case nandgate:
       case xorgate:
-        d->olist->sig = low;
+        s.sig[out] = low;
         break;
       case dtype:
-        d->memory = low;
-        d->olist->sig = high;
-        d->olist->next->sig = low;
+        s.memory[i] = low;
+        s.sig[out] = low;       // Q
+        s.sig[out + 1] = high;  // QBAR
         break;
       case imported:
-        d->device->dmz->resetdevices();
+        d->device->module->dmz->resetdevices (s.imported[impslot[i]]);
         break;
       case aselect:
         break;
       case siggen:
-        d->counter = 0;
-        d->bitstrpos = 0;
-        d->olist->sig = d->bitstr[0] ? high : low;
+        s.counter[i] = 0;
+        s.bitstrpos[i] = 0;
+        s.sig[out] = d->bitstr[0] ? high : low;
         break;
       default:
         break;
     }
   }
+  // every device needs to be executed again
+  s.ready = false;
+  s.quiet = false;
+  s.result = steadycycle;
+  s.looping.clear ();
+}
+
+
+/** Selects the engine used by executedevices.
+ *
+ * @author Diesel
+ */
+void devices::setengine (simengine e)
+{
+  engine = e;
+  settleinputs = (e == levelizedengine);
+  prepareevents ();
+  state.ready = false;
+  for (devlink d = netz->devicelist(); d; d = d->next) {
+    if (d->kind == imported)
+      d->device->module->dmz->setengine(e);
+  }
+}
+
+
+/** Returns the engine used by executedevices.
+ *
+ * @author Diesel
+ */
+simengine devices::getengine () const
+{
+  return engine;
+}
+
+
+/** Sets how executedevices settles each cycle.
+ *
+ * @author Diesel
+ */
+void devices::setsettle (const settleoptions& opts)
+{
+  settle = opts;
+  settle.limit = std::max (1, std::min (maxsettlelimit, opts.limit));
+  for (devlink d = netz->devicelist(); d; d = d->next) {
+    if (d->kind == imported)
+      d->device->module->dmz->setsettle(settle);
+  }
+}
+
+
+/** Returns how executedevices settles each cycle.
+ *
+ * @author Diesel
+ */
+const settleoptions& devices::getsettle () const
+{
+  return settle;
 }
 
 
@@ -713,6 +1658,16 @@ void devices::debug (bool on)
 }
 
 
+/** Starts or stops profiling the simulation.
+ *
+ * @author Diesel
+ */
+void devices::profile (simstats* st)
+{
+  stats = st;
+}
+
+
 /** Initialises the devices object
  *  Registers the names of all the possible devices.
  *
@@ -732,6 +1687,11 @@ devices::devices (names* names_mod, network* net_mod)
   dtab[dtype]     =  nmz->lookup("DTYPE");
   dtab[baddevice] =  blankname;
   debugging = false;
+  stats = NULL;
+  engine = sweepengine;
+  settleinputs = false;
+  imports = NULL;
+  ownimports = NULL;
   datapin = nmz->lookup("DATA");
   clkpin  = nmz->lookup("CLK");
   setpin  = nmz->lookup("SET");
@@ -761,4 +1721,5 @@ devices::devices (names* names_mod, network* net_mod)
 /** Clears up resources allocated by devices
  */
 devices::~devices() {
+  delete ownimports;
 }
@@ -4,11 +4,105 @@
 
 #include <string>
 #include <vector>
+#include <cstdint>
 
 #include "../com/names.h"
 #include "../com/sourcepos.h"
 #include "../com/errorhandler.h"
 #include "network.h"
+#include "simkernel.h"
+#include "simstats.h"
+
+
+/** Simulation engines
+ *  sweepengine evaluates every device on every machine cycle, eventengine
+ *  only evaluates devices whose inputs have changed. Both give the same
+ *  results. levelizedengine evaluates changed devices in levelized order (see
+ *  simkernel::levelize) and gates read rising and falling inputs as high and
+ *  low, so logic without feedback settles in a single pass. The devices of
+ *  a loop read their inputs as they are, in device list order, as the
+ *  sweep engine does, once the logic feeding them has settled. It reaches
+ *  the same steady states, but transients, and races between clocked
+ *  devices or into a latch, can resolve differently.
+ */
+typedef enum {sweepengine, eventengine, levelizedengine} simengine;
+
+const int maxmachinecycles = 20;     /* default machine cycles allowed for a cycle to settle */
+const int maxsettlelimit = 1000000;  /* most machine cycles a cycle can be allowed */
+const int maxperiod = 64;            /* longest loop of machine cycles looked for */
+
+
+/** When executedevices takes a cycle to have converged
+ *  steadyconverge    once a machine cycle changes no signal
+ *  periodicconverge  also once the signals repeat those of an earlier machine
+ *                    cycle, so a network which oscillates for ever, such as a
+ *                    ring oscillator, is left going round its loop instead of
+ *                    failing to settle
+ */
+typedef enum {steadyconverge, periodicconverge} convergence;
+
+/** What executedevices does with a cycle which does not converge
+ *  abortpolicy     stop, returning ok false
+ *  indetpolicy     set the outputs still changing to indet, and settle again
+ *  continuepolicy  carry on with the signals as they are
+ */
+typedef enum {abortpolicy, indetpolicy, continuepolicy} settlepolicy;
+
+/** How the last cycle executed ended
+ *  steadycycle       a machine cycle changed no signal
+ *  periodiccycle     the signals repeated, and periodicconverge accepts that
+ *  oscillatingcycle  the signals repeated, so would never settle
+ *  limitcycle        the signals were still changing after the settle limit
+ *  The last two are where the cycle failed to converge.
+ */
+typedef enum {steadycycle, periodiccycle, oscillatingcycle, limitcycle} cycleresult;
+
+
+/** How executedevices settles each cycle, see devices::setsettle.
+ */
+struct settleoptions {
+  int limit;                           // machine cycles allowed for a cycle to settle
+  convergence criterion;
+  settlepolicy policy;
+
+  /** Initialises the options to those the simulator has always used, a
+   *  limit of maxmachinecycles, steadyconverge and abortpolicy.
+   */
+  settleoptions ();
+};
+
+
+/** Simulation state of a network, everything which changes as it is
+ *  simulated. The network and its compiled kernel are only read while a
+ *  state is simulated, so any number of states can be simulated from the
+ *  same devices, each by one thread at a time. See devices::executedevices.
+ */
+struct devstate {
+  std::vector<asignal> sig;            // value of every signal, see simkernel
+  std::vector<asignal> memory;         // memory of each DTYPE, setting of each SWITCH
+  std::vector<int> counter;            // counter of each CLOCK and SIGGEN
+  std::vector<int> bitstrpos;          // position of each SIGGEN
+  std::vector<unsigned long long> pending;  // slots queued by the event engine
+  std::vector<unsigned long long> evcur, evnext;  // event engine worklists
+  std::vector<asignal> evold;          // scratch for detecting output changes
+  std::vector<devstate> imported;      // state of each imported device, in device order
+  uint64_t sighash;                    // hash of sig, updated by each change in a machine cycle
+  std::vector<uint64_t> seen;          // sighash after each machine cycle of the last cycle
+  std::vector<int32_t> looping;        // devices changing in the oscillation last found
+  cycleresult result;                  // how the last cycle ended
+  int revision;                        // kernel revision the state is for, or -1
+  simengine engine;                    // engine pending was queued for
+  bool ready;                          // pending is valid, otherwise run every device
+  bool steadystate;                    // no signal changed in the last machine cycle
+  bool quiet;                          // settled, and not changed since, see skipidle
+
+  /** Initialises an empty state, which is replaced by the current state of
+   *  the network when it is first simulated.
+   */
+  devstate ();
+};
+
+class importcache;
 
 
 /** Devices Class
@@ -22,31 +116,62 @@ class devices{
 
   typedef name devicetable[baddevice + 1];
   devicetable dtab;
-  bool        steadystate;
   bool        debugging;
+  settleoptions settle;              // limit and policy for settling each cycle
+  simstats*   stats;                 // counters updated while profiling, or NULL
 
-  void showdevice (devlink d);
+  simkernel   kernel;                // the compiled network being simulated
+  devstate    state;                 // the state simulated when none is given
+  simengine   engine;
+  bool        settleinputs;          // gates outside loops read rising as high and falling as low
+  std::vector<int32_t> evorder;      // devices in the order they are evaluated
+  std::vector<int32_t> evslot;       // position of each device in evorder
+  std::vector<int32_t> evalways;     // slots evaluated on every clock cycle
+  std::vector<int32_t> impslot;      // devstate::imported entry of each device, or -1
+  std::vector<int32_t> clockdevs;    // CLOCK, SIGGEN and imported devices, see updateclocks
+  importcache* imports;              // modules for imported devices
+  importcache* ownimports;           // imports, if not shared by another network
+
+  void showdevice (const devstate& s, int i);
   void makeswitch (name id, int setting, bool& ok, SourcePos at = SourcePos());
   void makeclock (name id, int frequency, SourcePos at = SourcePos());
   void makegate (devicekind dkind, name did, int ninputs, bool& ok, SourcePos at = SourcePos());
   void makedtype (name id, bool& ok, SourcePos at = SourcePos());
-  void signalupdate (asignal target, asignal& sig);
+  void signalupdate (devstate& s, asignal target, asignal& sig);
   asignal inv (asignal s);
-  void execswitch (devlink d);
-  void execgate (devlink d, asignal x, asignal y);
-  void execxorgate(devlink d);
-  void execdtype (devlink d);
-  void execclock(devlink d);
+  void execswitch (devstate& s, int i);
+  void execgate (devstate& s, int i, asignal x, asignal y);
+  void execxorgate(devstate& s, int i);
+  void execdtype (devstate& s, int i);
+  void execclock(devstate& s, int i);
+  void execdevice (devstate& s, int i, bool& ok);
   void outsig (asignal s);
+  void resolvepins (void);
+  void ensurecompiled (void);
+  void ensurestate (devstate& s);
+  void carrystate (devstate& s, const std::vector<int32_t>& oldslot);
+  void prepareevents (void);
+  bool evready (const devstate& s) const;
+  void markoutput (devstate& s, int i);
+  void runmachinecycle (devstate& s, bool& ok);
+  int runmachinecycles (devstate& s, bool& ok, int& period);
+  int repeated (devstate& s);
+  void findloop (devstate& s, int period, bool& ok);
+  void markindet (devstate& s);
+  int horizon (const devstate& s, int limit) const;
+  void advanceclocks (devstate& s, int ncycles);
+  void executesweep (devstate& s, bool& ok);
+  void executeevents (devstate& s, bool& ok);
+  void inlinedevice (devlink d);
 
 public:
   // Todo: Do these need to be public?
   void makeimported(name id, std::string fname, errorcollector& errs, SourcePos at = SourcePos());
-  void execimported(devlink d);
+  void execimported(devstate& s, int i);
   void makeselect (name id, int setting, bool& ok, SourcePos at = SourcePos());
-  void execselect(devlink d, bool& ok);
+  void execselect(devstate& s, int i);
   void makesiggen(name id, std::vector<bool> bits, int period, bool& ok, SourcePos at = SourcePos());
-  void execsiggen(devlink d);
+  void execsiggen(devstate& s, int i);
 
   name        clkpin, datapin, setpin;
   name        clrpin, qpin, qbarpin;     /* Input and Output Pin names */
@@ -76,6 +201,16 @@ public:
    */
   void setswitch (name sid, asignal level, bool& ok, SourcePos at = SourcePos());
 
+  /** Sets the named switch in a simulation state only, leaving the setting
+   *  of the switch in the network and in other states as they are.
+   *
+   * @param      s      The state to change.
+   * @param[in]  sid    The id in the name table of the switch to be set
+   * @param[in]  level  The new output signal of the switch.
+   * @param      ok     Returns false if the switch was not found.
+   */
+  void setswitch (devstate& s, name sid, asignal level, bool& ok);
+
   /** Sets the frequency of the named clock.
    *
    * @param[in]  sid        The id in the name table of the clock to be set
@@ -91,20 +226,192 @@ public:
    */
   void updateclocks (void);
 
+  /** Updates clocks in a simulation state.
+   *
+   * @param      s     The state to update.
+   */
+  void updateclocks (devstate& s);
+
   /** Executes all devices in the network to simulate one complete clock
    *  cycle.
    *
    * @param      ok    Returns false if an error occured, i.e. the network
-   *                   failed to stabilise.
+   *                   failed to stabilise with abortpolicy, see lastcycle.
    * @param[in]  tick  If false, then clocks aren't updated at the start of
    *                   execution.
    */
   void executedevices (bool& ok, bool tick = true);
 
+  /** Simulates one complete clock cycle of a simulation state. Only s is
+   *  changed, so different states can be simulated on different threads at
+   *  once, as long as the network is not changed and the engine, settle
+   *  options or debugging are not set meanwhile. A state which is empty, or
+   *  was made before the network last changed, is first replaced by a copy
+   *  of the current state.
+   *
+   * @param      s     The state to simulate.
+   * @param      ok    Returns false if the network failed to stabilise with
+   *                   abortpolicy.
+   * @param[in]  tick  If false, then clocks aren't updated at the start of
+   *                   execution.
+   */
+  void executedevices (devstate& s, bool& ok, bool tick = true);
+
+  /** Returns how the last cycle executed ended. With abortpolicy, a cycle
+   *  which did not converge is also one where executedevices returned ok
+   *  false, with the others it is still simulated, and the caller should
+   *  warn of it.
+   *
+   * @return     How the last cycle settled, or steadycycle if none has been
+   *             executed since the network changed.
+   */
+  cycleresult lastcycle (void);
+
+  /** Returns how the last cycle executed in a simulation state ended.
+   *
+   * @param[in]  s     The state simulated.
+   * @return     How the last cycle settled.
+   */
+  cycleresult lastcycle (const devstate& s);
+
+  /** Returns the devices which were found to oscillate, when the last cycle
+   *  executed did not settle. A network is found to be oscillating as soon
+   *  as the signals in a machine cycle repeat those of an earlier one, and
+   *  the devices returned are those whose outputs change in the loop. If
+   *  the signals had not repeated by the settle limit, none are returned
+   *  with abortpolicy, and with the other policies those whose outputs
+   *  change in one more machine cycle.
+   *
+   * @param      devs  Returns the devices oscillating, in device order.
+   */
+  void oscillating (std::vector<devlink>& devs);
+
+  /** Returns the devices which were found to oscillate in a simulation state.
+   *
+   * @param[in]  s     The state simulated.
+   * @param      devs  Returns the devices oscillating, in device order.
+   */
+  void oscillating (const devstate& s, std::vector<devlink>& devs);
+
+  /** Skips the next cycles in which no CLOCK or SIGGEN changes, when the
+   *  network has settled and nothing has been changed since. Executing those
+   *  cycles would only count the clocks on, so that is all that is done.
+   *  Nothing is skipped while debugging, as the devices would not be shown.
+   *
+   * @param[in]  maxcycles  The most cycles to skip.
+   * @return     The number of cycles skipped, from 0 to maxcycles. The
+   *             signals are the same in each cycle skipped as they are now.
+   */
+  int skipidle (int maxcycles);
+
+  /** Skips idle cycles of a simulation state, as skipidle.
+   *
+   * @param      s          The state to simulate.
+   * @param[in]  maxcycles  The most cycles to skip.
+   * @return     The number of cycles skipped.
+   */
+  int skipidle (devstate& s, int maxcycles);
+
   /** Resets the outputs of devices in the network to zero
    */
   void resetdevices();
 
+  /** Resets the outputs of devices in a simulation state to zero.
+   *
+   * @param      s     The state to reset.
+   */
+  void resetdevices (devstate& s);
+
+  /** Replaces every imported device with copies of the devices in its
+   *  network, named after the imported device, so gate G of imported device
+   *  A becomes A.G, and the devices A imports become A.B.G. The outputs of an
+   *  imported device are moved onto the devices driving them, so connections
+   *  and monitors are kept. The whole design then settles in one loop of
+   *  machine cycles, instead of a complete simulation cycle being run inside
+   *  each imported device every machine cycle. Transients between clocked
+   *  devices can resolve differently. Devices are reset afterwards.
+   */
+  void flatten (void);
+
+  /** Compiles the network into the flat form used by the simulator. This is
+   *  done automatically when the network has changed since it was last
+   *  compiled, but can be called once the network is complete to do so
+   *  up front.
+   */
+  void compile (void);
+
+  /** Returns the current value of a device output.
+   *
+   * @param[in]  o     The output to read.
+   * @return     The signal on the output, or low if the network has not been
+   *             compiled since the output was added.
+   */
+  asignal getsignal (outplink o) const;
+
+  /** Returns the value of a device output in a simulation state.
+   *
+   * @param[in]  s     The state to read.
+   * @param[in]  o     The output to read.
+   * @return     The signal on the output, or low if s is not a state of the
+   *             network as last compiled.
+   */
+  asignal getsignal (const devstate& s, outplink o) const;
+
+  /** Copies the simulation state of the network.
+   *
+   * @param      s     Returns the state.
+   */
+  void getstate (devstate& s);
+
+  /** Exchanges the simulation state of the network with s. A state taken from
+   *  the network with getstate or swapstate can be swapped back in, as long as
+   *  the network has not changed since, otherwise s is replaced by a copy of
+   *  the current state.
+   *
+   * @param      s     The state to simulate from, returns the previous state.
+   */
+  void swapstate (devstate& s);
+
+  /** Shares a cache of imported files with this network, so each file is
+   *  only parsed once. Used for the networks of imported devices.
+   *
+   * @param      cache  The cache to load imported devices from.
+   */
+  void setimportcache (importcache* cache);
+
+  /** Returns the compiled network, compiling it first if it has changed.
+   *
+   * @return     The simulation kernel of the network.
+   */
+  const simkernel& getkernel (void);
+
+  /** Selects the engine used by executedevices.
+   *
+   * @param[in]  e     The simulation engine to use.
+   */
+  void setengine (simengine e);
+
+  /** Returns the engine used by executedevices.
+   *
+   * @return     The current simulation engine.
+   */
+  simengine getengine () const;
+
+  /** Sets how executedevices settles each cycle: the most machine cycles it
+   *  runs, whether a loop of signals counts as settled, and what is done
+   *  with a cycle which does not converge. Applies to imported devices too.
+   *
+   * @param[in]  opts  The options to use, with a limit from 1 to
+   *                   maxsettlelimit.
+   */
+  void setsettle (const settleoptions& opts);
+
+  /** Returns how executedevices settles each cycle.
+   *
+   * @return     The current options.
+   */
+  const settleoptions& getsettle () const;
+
   /** Returns the kind of device corresponding to the given name.
    *
    * @param[in]  id    The identifier in the name table to search for
@@ -133,6 +440,14 @@ public:
    */
   void debug (bool on);
 
+  /** Starts or stops profiling the simulation, see simstats. Clocks and
+   *  devices are counted as they are executed, and added to the counters
+   *  given until profiling is stopped.
+   *
+   * @param      st    The counters to add to, or NULL to stop profiling.
+   */
+  void profile (simstats* st);
+
   /** Initialises the devices object
    *
    * @param      names_mod  The names class instance to use.
@@ -0,0 +1,272 @@
+/* Unit tests for the simulation engines.
+ * Each definition file in test_files is simulated with every engine, and the
+ * monitor traces compared with those of the sweep engine, which is taken as
+ * the reference. The levelized engine is also profiled, to check logic
+ * feeding a loop settles in one pass, and separate simulation states of one
+ * network simulated on separate threads, to check they match a serial run.
+ *
+ * Tests are run from the top directory of the project, as make does.
+ *
+ * Tests require the google test framework
+ * https://github.com/google/googletest
+ *
+ * @author     Diesel
+ */
+
+
+#include "devices.h"
+#include "gtest/gtest.h"
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <thread>
+#include <dirent.h>
+
+#include "../com/names.h"
+#include "../sim/network.h"
+#include "../sim/monitor.h"
+#include "../sim/simstats.h"
+#include "../lang/scanner.h"
+#include "../lang/parser.h"
+
+
+static const char* const testdir = "test_files/";
+static const char* const enginenames[] = {"sweep", "event", "levelized"};
+
+
+// Lists the definition files in test_files, sorted by name
+static std::vector<std::string> testfiles() {
+    std::vector<std::string> files;
+    DIR* dir = opendir(testdir);
+    if (!dir)
+        return files;
+    while (struct dirent* ent = readdir(dir)) {
+        std::string f = ent->d_name;
+        if (f.size() > 5 && f.compare(f.size() - 5, 5, ".matt") == 0)
+            files.push_back(f);
+    }
+    closedir(dir);
+    std::sort(files.begin(), files.end());
+    return files;
+}
+
+
+// Engine test controller, holding one parsed definition file
+// @author   Diesel
+class EngineTest : public ::testing::Test {
+    protected:
+
+    names* nmz;
+    network* netz;
+    devices* dmz;
+    monitor* mmz;
+
+    virtual void SetUp() {
+        nmz = new names();
+        netz = new network(nmz);
+        dmz = new devices(nmz, netz);
+        mmz = new monitor(nmz, netz, dmz);
+    }
+
+    virtual void TearDown() {
+        delete mmz;
+        delete dmz;
+        delete netz;
+        delete nmz;
+    }
+
+    bool readfile(std::string fname) {
+        fscanner smz(nmz);
+        if (!smz.open(fname))
+            return false;
+        parser pmz(netz, dmz, mmz, &smz, nmz);
+        return pmz.readin();
+    }
+
+    bool readstring(std::string def) {
+        strscanner smz(nmz, def);
+        parser pmz(netz, dmz, mmz, &smz, nmz);
+        return pmz.readin();
+    }
+
+    // Runs from reset with an engine, stopping at a cycle which fails to
+    // settle as the user interface does, and returns each monitor's trace as
+    // text, followed by the number of cycles run.
+    std::vector<std::string> run(simengine e, int ncycles) {
+        std::vector<std::string> traces(mmz->moncount());
+        bool ok = true;
+        int c;
+        asignal s;
+        dmz->setengine(e);
+        dmz->resetdevices();
+        mmz->resetmonitor();
+        for (c = 0; c < ncycles && ok; c++) {
+            dmz->executedevices(ok);
+            if (ok)
+                mmz->recordsignals();
+        }
+        for (int m = 0; m < mmz->moncount(); m++) {
+            for (int i = 0; i < mmz->cycles(); i++) {
+                EXPECT_TRUE(mmz->getsignaltrace(m, i, s));
+                traces[m] += "f_r-zX"[s];
+            }
+        }
+        traces.push_back(std::to_string(c));
+        return traces;
+    }
+
+    // Runs a copy of a state from reset, with the switches set to the bits
+    // of setting, and returns each monitor's trace as text, followed by the
+    // number of cycles run. Only the copy is changed, so states can be run
+    // on separate threads at once.
+    std::string runstate(const devstate& st, const std::vector<name>& switches,
+                         int setting, int ncycles) {
+        std::string traces;
+        devstate s = st;
+        bool ok = true;
+        int c;
+        dmz->resetdevices(s);
+        for (unsigned int i = 0; i < switches.size(); i++)
+            dmz->setswitch(s, switches[i], ((setting >> i) & 1) ? high : low, ok);
+        for (c = 0; c < ncycles && ok; c++) {
+            dmz->executedevices(s, ok);
+            if (!ok)
+                break;
+            for (int m = 0; m < mmz->moncount(); m++)
+                traces += "f_r-zX"[dmz->getsignal(s, mmz->getoutplink(m))];
+            traces += '\n';
+        }
+        return traces + std::to_string(c);
+    }
+};
+
+
+// Every engine gives the same traces as the sweep engine on every test file,
+// including those with latches made of gates. Files with errors, kept to
+// test the parser, are skipped.
+// @author   Diesel
+TEST_F(EngineTest, EnginesMatchSweepOnTestFiles) {
+    std::vector<std::string> files = testfiles();
+    int simulated = 0;
+    ASSERT_FALSE(files.empty()) << "No definition files found in " << testdir;
+
+    for (const std::string& f : files) {
+        SCOPED_TRACE(f);
+        TearDown();
+        SetUp();
+        if (!readfile(testdir + f))
+            continue;
+        simulated++;
+
+        std::vector<std::string> sweep = run(sweepengine, 40);
+        for (simengine e : {eventengine, levelizedengine}) {
+            std::vector<std::string> traces = run(e, 40);
+            ASSERT_EQ(sweep.size(), traces.size());
+            for (unsigned int m = 0; m < traces.size(); m++)
+                EXPECT_EQ(sweep[m], traces[m]) << "monitor " << m << " with the "
+                    << enginenames[e] << " engine";
+        }
+    }
+    EXPECT_GT(simulated, 0);
+}
+
+// A chain of inverters, declared deepest first, feeding a latch. Only the
+// latch is a loop, so with the levelized engine a change runs down the chain
+// in one ordered pass, whatever its depth. Each inverter is evaluated as its
+// output starts to change, as it gets there, and once more to find it has
+// settled, and the latch is set a machine cycle later. With the chain in
+// list order, as the sweep engine takes it, it would need a machine cycle
+// per inverter
+// @author   Diesel
+TEST_F(EngineTest, LogicFeedingLatchSettlesInOnePass) {
+    const int depth = 60;
+    std::string def = "dev S = SWITCH { Initialvalue : 0; }\n"
+        "dev R = SWITCH { Initialvalue : 1; }\n"
+        "dev Q = NOR;\ndev QBAR = NOR;\n";
+    for (int i = depth; i >= 1; i--)
+        def += "dev C" + std::to_string(i) + " = NAND;\n";
+    def += "dev C1 { I1 : S; }\n";
+    for (int i = 2; i <= depth; i++)
+        def += "dev C" + std::to_string(i) + " { I1 : C" + std::to_string(i - 1) + "; }\n";
+    def += "dev Q { I1 : R; I2 : QBAR; }\n"
+        "dev QBAR { I1 : C" + std::to_string(depth) + "; I2 : Q; }\n"
+        "monitor Q, QBAR;\n";
+    ASSERT_TRUE(readstring(def));
+
+    simstats st;
+    bool ok = true;
+    asignal q;
+    dmz->setengine(levelizedengine);
+    dmz->resetdevices();
+    mmz->resetmonitor();
+    dmz->executedevices(ok);
+    ASSERT_TRUE(ok);
+    dmz->setswitch(nmz->cvtname("R"), low, ok);
+    ASSERT_TRUE(ok);
+    dmz->executedevices(ok);
+    ASSERT_TRUE(ok);
+    mmz->recordsignals();
+    ASSERT_TRUE(mmz->getsignaltrace(0, 0, q));
+    EXPECT_EQ(low, q);
+
+    // the even length chain sets the latch when S rises
+    dmz->profile(&st);
+    dmz->setswitch(nmz->cvtname("S"), high, ok);
+    ASSERT_TRUE(ok);
+    dmz->executedevices(ok);
+    ASSERT_TRUE(ok);
+    dmz->profile(NULL);
+    mmz->recordsignals();
+    ASSERT_TRUE(mmz->getsignaltrace(0, 1, q));
+    EXPECT_EQ(high, q);
+    EXPECT_EQ(3 * depth, st.evals[nandgate]);
+    EXPECT_EQ(1, st.cycles);
+    EXPECT_EQ(0, st.unsettled);
+    EXPECT_LE(st.settle.size(), 5u);
+}
+
+// Separate states of one network, each with its own switch settings, give
+// the same traces simulated on separate threads at once as one after the
+// other, with every engine
+// @author   Diesel
+TEST_F(EngineTest, StatesOnThreadsMatchSerialRun) {
+    const int nstates = 8;
+    std::vector<std::string> files = testfiles();
+    ASSERT_FALSE(files.empty()) << "No definition files found in " << testdir;
+
+    for (const std::string& f : files) {
+        SCOPED_TRACE(f);
+        TearDown();
+        SetUp();
+        if (!readfile(testdir + f))
+            continue;
+        std::vector<name> switches;
+        for (devlink d = netz->devicelist(); d != NULL; d = d->next) {
+            if (d->kind == aswitch)
+                switches.push_back(d->id);
+        }
+
+        for (simengine e : {sweepengine, eventengine, levelizedengine}) {
+            SCOPED_TRACE(enginenames[e]);
+            devstate st;
+            dmz->setengine(e);
+            dmz->resetdevices();
+            dmz->getstate(st);
+
+            std::vector<std::string> serial, threaded(nstates);
+            for (int n = 0; n < nstates; n++)
+                serial.push_back(runstate(st, switches, n, 40));
+            std::vector<std::thread> pool;
+            for (int n = 0; n < nstates; n++) {
+                pool.push_back(std::thread([&, n]() {
+                    threaded[n] = runstate(st, switches, n, 40);
+                }));
+            }
+            for (auto& th : pool)
+                th.join();
+            for (int n = 0; n < nstates; n++)
+                EXPECT_EQ(serial[n], threaded[n]) << "setting " << n;
+        }
+    }
+}
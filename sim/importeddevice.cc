@@ -1,6 +1,8 @@
 
 #include <map>
 #include <string>
+#include <climits>
+#include <cstdlib>
 
 #include "../com/localestrings.h"
 #include "../lang/scanner.h"
@@ -9,22 +11,23 @@
 #include "importeddevice.h"
 
 
-/** Initialises a new importeddevice structure
+/** Initialises an empty module.
  *
  * @author Diesel
  */
-importeddevice::importeddevice(names* nm, errorcollector& errc)
-        : nmz(nm), errs(errc) {
+importedmodule::importedmodule(names* nm, importcache* cache)
+        : nmz(nm), ok(false) {
     netz = new network(nmz);
     dmz = new devices(nmz, netz);
-    mmz = new monitor(nmz, netz);
+    dmz->setimportcache(cache);
+    mmz = new monitor(nmz, netz, dmz);
 }
 
-/** Clears resources allocated by importeddevice
+/** Clears resources allocated by importedmodule
  *
  * @author Diesel
  */
-importeddevice::~importeddevice() {
+importedmodule::~importedmodule() {
     delete mmz;
     delete dmz;
     delete netz;
@@ -35,16 +38,19 @@ importeddevice::~importeddevice() {
  *
  * @author Diesel
  */
-bool importeddevice::scanAndParse(std::string file) {
+bool importedmodule::scanAndParse(std::string file, errorcollector& errs) {
     fscanner* smz = new fscanner(nmz);
     if (smz->open(file)) {
         parser pmz(netz, dmz, mmz, smz, nmz);
 
-        bool ok = pmz.readin();
+        ok = pmz.readin();
 
         if (ok) {
             // Find inputs
             inputs = netz->findswitches();
+            for (unsigned int n = 0; n < inputs.size(); n++) {
+                inport.emplace(inputs[n]->id, n);
+            }
 
             // Find outputs
             name D, P;
@@ -54,13 +60,14 @@ bool importeddevice::scanAndParse(std::string file) {
                     errs.report(mattwarning(t("In imported devices, monitors using pin names are ignored. "), mmz->getdefinedpos(n)));
                 }
                 else {
+                    outport.emplace(D, outputs.size());
                     outputs.push_back({D, mmz->getoutplink(n)});
                 }
             }
 
             // Check
             if (outputs.empty()) {
-                errs.report(mattwarning(t("No outputs defined for imported device."), SourcePos(file, 0, 0, 0)));
+                errs.report(mattwarning(t("No outputs defined for imported device."), SourcePos(file)));
             }
             // Todo: Other checks required?
         }
@@ -68,7 +75,7 @@ bool importeddevice::scanAndParse(std::string file) {
         return ok;
     }
     else {
-        throw mattruntimeerror(t("Unable to open file for importing."), SourcePos(file, 0, 0, 0));
+        throw mattruntimeerror(t("Unable to open file for importing."), SourcePos(file));
     }
 
     delete smz;
@@ -77,85 +84,82 @@ bool importeddevice::scanAndParse(std::string file) {
 }
 
 
-/** Updates the clocks in the device.
+/** Initialises an empty cache.
  *
  * @author Diesel
  */
-void importeddevice::tick() {
-    dmz->updateclocks();
+importcache::importcache(names* nm) : nmz(nm) {
 }
 
 
-/** Executes the imported device.
+/** Returns the module for a file, parsing it if it has not been loaded.
  *
  * @author Diesel
  */
-void importeddevice::execute() {
-    bool ok = true;
-
-    // Execute devices without incrementing clocks.
-    dmz->executedevices(ok, false);
+std::shared_ptr<importedmodule> importcache::load(const std::string& file, errorcollector& errs) {
+    char buf[PATH_MAX];
+    std::string key = realpath(file.c_str(), buf) ? std::string(buf) : file;
 
-    if (!ok) {
-        // Todo: Report position
-        throw mattruntimeerror(t("Imported device network failed to stabilise."), SourcePos());
+    auto it = modules.find(key);
+    if (it != modules.end()) {
+        return it->second;
     }
+
+    std::shared_ptr<importedmodule> mod = std::make_shared<importedmodule>(nmz, this);
+    mod->scanAndParse(file, errs);
+    modules[key] = mod;
+    return mod;
 }
 
 
-/** Checks if the imported device has an input pin.
+/** Returns the number of files loaded.
  *
  * @author Diesel
  */
-bool importeddevice::hasInput(name pin) const {
-    for (auto it : inputs) {
-        if (it->id == pin) {
-            return true;
-        }
-    }
-    return false;
+int importcache::size() const {
+    return modules.size();
 }
 
 
-/** Checks if the imported device has an output pin
+/** Initialises a new imported device.
  *
  * @author Diesel
  */
-bool importeddevice::hasOutput(name mon) const {
-    for (auto it : outputs) {
-        if (it.first == mon) {
-            return true;
-        }
-    }
-    return false;
+importeddevice::importeddevice(std::shared_ptr<importedmodule> mod)
+        : module(mod) {
 }
 
 
-/** Sets the value of an input pin
+/** Looks up the module port of each pin of the device.
  *
  * @author Diesel
  */
-bool importeddevice::setInput(name pin, asignal value) {
-    for (auto it : inputs) {
-        if (it->id == pin) {
-            it->swstate = value;
-            return true;
-        }
+void importeddevice::bindports(devicerec* d) {
+    inpos.clear();
+    for (inputrec* il = d->ilist; il; il = il->next) {
+        inpos.push_back(module->inport.at(il->id));
+    }
+    outpos.clear();
+    for (outputrec* ol = d->olist; ol; ol = ol->next) {
+        outpos.push_back(module->outport.at(ol->id));
     }
-    return false;
 }
 
 
-/** Retrieves the value of an output pin.
+/** Checks if the imported device has an input pin.
  *
  * @author Diesel
  */
-bool importeddevice::getOutput(name mon, asignal& value) {
-    for (auto it : outputs) {
-        if (it.first == mon) {
-            value = it.second->sig;
-            return true;
-        }
-    }
-    return false;
+bool importeddevice::hasInput(name pin) const {
+    return module->inport.count(pin) > 0;
 }
+
+
+/** Checks if the imported device has an output pin
+ *
+ * @author Diesel
+ */
+bool importeddevice::hasOutput(name mon) const {
+    return module->outport.count(mon) > 0;
+}
+
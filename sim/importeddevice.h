@@ -1,62 +1,125 @@
-
 #ifndef GF2_IMPORTEDDEVICE_H
 #define GF2_IMPORTEDDEVICE_H
 
 #include <vector>
+#include <string>
+#include <memory>
+#include <unordered_map>
 
 #include "../com/names.h"
 #include "../com/errorhandler.h"
 #include "network.h"
-// #include "../sim/devices.h"
+#include "devices.h"
 // #include "../sim/monitor.h"
-class devices;
 class monitor;
+class importcache;
 
 
-/** Data for an imported device
+/** A parsed Mattlang file, shared by every device imported from it.
+ *
+ *  The network is parsed once and not changed afterwards. Each device
+ *  imported from the file is simulated on its own devstate, held in the
+ *  state of the network it is imported into, see devices::execimported.
+ *  dmz holds the state the network was reset to, which new devices start
+ *  from.
  *
  * @author Diesel
  */
-struct importeddevice {
+struct importedmodule {
     names* nmz;
     network* netz;
     devices* dmz;
     monitor* mmz;
-    errorcollector& errs;
+    bool ok;                 // the file was scanned and parsed without error
 
     std::vector<devicerec*> inputs;
     std::vector<std::pair<name, outputrec*>> outputs;
+    std::unordered_map<name, int, namehash> inport;   // position of each input in inputs
+    std::unordered_map<name, int, namehash> outport;  // position of each output in outputs
 
-    /** Initialises a new importeddevice structure
+    /** Initialises an empty module.
      *
-     * @param      nm    The name table instance to use.
-     * @param      errc  A reference to an errorcollector to report errors to.
+     * @param      nm      The name table instance to use.
+     * @param      cache   The cache any devices imported by the module are
+     *                     loaded from.
      */
-    importeddevice(names* nm, errorcollector& errc);
+    importedmodule(names* nm, importcache* cache);
 
-    /** Clears resources allocated by importeddevice
+    /** Clears resources allocated by importedmodule
      */
-    ~importeddevice();
+    ~importedmodule();
 
     /** Reads in a Mattlang circuit definition and parses it to a network.
      *
      * @param[in]  file  The path to the file, relative to the current working
      *                   directory.
+     * @param      errs  The errorcollector to report warnings to.
      *
      * @return     Returns true if the file was scanned and parsed without error.
      */
-    bool scanAndParse(std::string file);
+    bool scanAndParse(std::string file, errorcollector& errs);
+};
+
+
+/** Modules loaded for imported devices, so each file is parsed once however
+ *  many devices are imported from it. Files are identified by their canonical
+ *  path. Shared by a network and all the networks imported into it.
+ *
+ * @author Diesel
+ */
+class importcache {
+    names* nmz;
+    std::unordered_map<std::string, std::shared_ptr<importedmodule>> modules;
+
+ public:
+    /** Returns the module for a file, parsing it if it has not been loaded.
+     *
+     * @param[in]  file  The path to the file, relative to the current working
+     *                   directory.
+     * @param      errs  The errorcollector to report warnings to when the file
+     *                   is parsed.
+     * @return     The module, which may have failed to parse, see
+     *             importedmodule::ok.
+     */
+    std::shared_ptr<importedmodule> load(const std::string& file, errorcollector& errs);
+
+    /** Returns the number of files loaded.
+     *
+     * @return     The number of modules in the cache.
+     */
+    int size() const;
 
-    /** Updates the clocks in the device.
-     *  Should be called once per simulation cycle.
+    /** Initialises an empty cache.
+     *
+     * @param      nm    The name table instance to use.
      */
-    void tick();
+    importcache(names* nm);
+};
+
+
+/** Data for an imported device. Its simulation state is held in a devstate,
+ *  see devstate::imported.
+ *
+ * @author Diesel
+ */
+struct importeddevice {
+    std::shared_ptr<importedmodule> module;
+    std::vector<int> inpos;           // module->inputs entry of each input pin, see bindports
+    std::vector<int> outpos;          // module->outputs entry of each output pin
 
-    /** Executes the imported device.
-     *  This is essentially a simulation cycle for the device, but without
-     *  updating clocks.
+    /** Initialises a new imported device.
+     *
+     * @param      mod   The module the device is imported from.
      */
-    void execute();
+    importeddevice(std::shared_ptr<importedmodule> mod);
+
+    /** Looks up the module port of each pin of the device once, so they can
+     *  be copied in and out by position, in the order of the device's input
+     *  and output lists. Must be called again if pins are added.
+     *
+     * @param      d     The device record of this device.
+     */
+    void bindports(devicerec* d);
 
     /** Checks if the imported device has an input pin.
      *
@@ -71,22 +134,6 @@ struct importeddevice {
      * @return     True if the output exists, False otherwise.
      */
     bool hasOutput(name mon) const;
-
-    /** Sets the value of an input pin
-     *
-     * @param      pin    The id in the name table of an input pin.
-     * @param      value  The new value of the input.
-     * @return     True if the input could be set, false otherwise.
-     */
-    bool setInput(name pin, asignal value);
-
-    /** Retrieves the value of an output pin.
-     *
-     * @param[in]  mon    The id in the name table of an output pin.
-     * @param      value  Returns the value of the output pin.
-     * @return     True if the output could be retrieved. False otherwise.
-     */
-    bool getOutput(name mon, asignal& value);
 };
 typedef importeddevice* importedlink;
 
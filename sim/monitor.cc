@@ -1,5 +1,6 @@
 
 #include <iostream>
+#include <chrono>
 #include "../com/names.h"
 #include "monitor.h"
 
@@ -39,18 +40,26 @@ void monitor::makemonitor (name dev, name outp, bool& ok, name aliasDevice, name
   ok = (mtab.size() < maxmonitors);
   if (ok) {
     d = netz->finddevice (dev);
+    if (d == NULL && outp != blankname) {
+      // a device inlined from an imported device, see devices::flatten
+      d = netz->finddevice (nmz->cvtname (nmz->namestr (dev) + "." + nmz->namestr (outp)));
+      if (d != NULL)
+        o = netz->findoutput (d, blankname);
+    }
+    else if (d != NULL)
+      o = netz->findoutput (d, outp);
     ok = (d != NULL);
     if (ok) {
-      o = netz->findoutput (d, outp);
       ok = (o != NULL);
       if (ok) {
         moninfo newmon;
         newmon.devid = dev;
+        newmon.pinid = outp;
         newmon.op = o;
         newmon.definedAt = p;
         newmon.aliasDev = aliasDevice;
         newmon.aliasPin = aliasOutp;
-        newmon.sig.reserve(50);
+        newmon.sig.setcapacity(capacity);
 
         mtab.push_back(newmon);
       }
@@ -72,7 +81,7 @@ void monitor::remmonitor (name dev, name outp, bool& ok)
     found = false;
     for (i = 0; ((i < mtab.size()) && (! found)); i++)
       found = ((mtab[i].devid == dev) &&
-         (mtab[i].op->id == outp));
+         (mtab[i].pinid == outp));
     ok = found;
     if (found) { // Remove the monitor
       mtab.erase(mtab.begin() + i - 1);
@@ -112,7 +121,7 @@ asignal monitor::getmonsignal (int n) const {
 asignal monitor::getmonsignal(const moninfo& mon) const {
   if (!mon.op) return floating;
 
-  return mon.op->sig;
+  return dmz->getsignal(mon.op);
 }
 
 
@@ -134,7 +143,7 @@ void monitor::getmonname (moninfo& mon, name& dev, name& outp, bool alias)
   }
   else {
     dev = mon.devid;
-    outp = mon.op->id;
+    outp = mon.pinid;
   }
 }
 
@@ -148,6 +157,7 @@ void monitor::resetmonitor (void)
   for (auto& it : mtab) {
     it.sig.clear();
   }
+  vcd->restart();
 }
 
 
@@ -155,14 +165,104 @@ void monitor::resetmonitor (void)
  *
  * @author Gee, Diesel
  */
-void monitor::recordsignals (void)
+void monitor::recordsignals (int ncycles)
+{
+  std::chrono::steady_clock::time_point t0;
+  if (stats)
+    t0 = std::chrono::steady_clock::now ();
+  for (auto& m : mtab) {
+    if (ncycles == 1)
+      m.sig.push(getmonsignal(m));
+    else
+      m.sig.push(getmonsignal(m), ncycles);
+  }
+  vcd->record(ncycles);
+  if (stats) {
+    stats->recordtime += std::chrono::duration<double> (std::chrono::steady_clock::now () - t0).count ();
+    stats->recorded += ncycles;
+  }
+}
+
+
+/** Starts or stops timing recordsignals.
+ *
+ * @author Diesel
+ */
+void monitor::profile (simstats* st)
+{
+  stats = st;
+}
+
+
+/** Sets the number of cycles of history kept for each monitor.
+ *
+ * @author Diesel
+ */
+void monitor::setcapacity (int n)
+{
+  capacity = (n < 1) ? 1 : n;
+  for (auto& m : mtab) {
+    m.sig.setcapacity(capacity);
+  }
+}
+
+
+/** Returns the number of cycles of history kept for each monitor.
+ *
+ * @author Diesel
+ */
+int monitor::getcapacity (void) const
+{
+  return capacity;
+}
+
+
+/** Copies the history of every monitor.
+ *
+ * @author Diesel
+ */
+void monitor::gethistory (std::vector<tracebuffer>& h) const
 {
+  h.clear();
   for (auto& m : mtab) {
-    m.sig.push_back(getmonsignal(m));
-    // limit size to maxcycles by removing first values
-    if (m.sig.size() > maxcycles)
-      m.sig.erase(m.sig.begin());
+    h.push_back(m.sig);
+  }
+}
+
+
+/** Replaces the history of every monitor.
+ *
+ * @author Diesel
+ */
+bool monitor::sethistory (const std::vector<tracebuffer>& h)
+{
+  if (h.size() != mtab.size())
+    return false;
+  for (unsigned int n = 0; n < h.size(); n++) {
+    mtab[n].sig = h[n];
+    mtab[n].sig.setcapacity(capacity);
   }
+  return true;
+}
+
+
+/** Starts streaming the monitored signals to a VCD file.
+ *
+ * @author Diesel
+ */
+bool monitor::startvcd (std::string fname)
+{
+  return vcd->open(fname);
+}
+
+
+/** Finishes and closes the VCD file.
+ *
+ * @author Diesel
+ */
+void monitor::stopvcd (void)
+{
+  vcd->close();
 }
 
 
@@ -173,7 +273,7 @@ void monitor::recordsignals (void)
 bool monitor::getsignaltrace(int m, int c, asignal &s)
 {
   if ((m < moncount()) && (c < mtab[m].sig.size())) {
-    s = mtab[m].sig[c];
+    s = mtab[m].sig.get(c);
     return true;
   }
   return false;
@@ -185,40 +285,71 @@ bool monitor::getsignaltrace(int m, int c, asignal &s)
  * @author Gee
  */
 void monitor::displaysignals (void)
+{
+  for (auto& mon : mtab) {
+    displayname (mon);
+    for (int c = 0; c < mon.sig.size(); c++)
+      cout << tracechar (mon.sig.get(c));
+    cout << endl;
+  }
+}
+
+
+/** Displays a trace of a monitored signal recorded elsewhere
+ *
+ * @author Diesel
+ */
+void monitor::displaytrace (int m, const std::vector<asignal>& trace)
+{
+  displayname (mtab[m]);
+  for (asignal s : trace)
+    cout << tracechar (s);
+  cout << endl;
+}
+
+
+/** Prints the name of a monitor, padded to the start of its trace
+ *
+ * @author Gee
+ */
+void monitor::displayname (moninfo& mon)
 {
   const int margin = 20;
-  int n, i;
+  int i;
   name dev, outp;
   int namesize;
-  for (auto mon : mtab) {
-
-    // Print monitor name
-    getmonname(mon, dev, outp);
-    namesize = nmz->namelength(dev);
-    cout << nmz->namestr(dev);
-    if (outp != blankname) {
-      cout << "." << nmz->namestr(outp);
-      namesize = namesize + nmz->namelength(outp) + 1;
-    }
 
-    if ((margin - namesize) > 0) {
-      for (i = 0; i < (margin - namesize - 1); i++)
-        cout << " ";
-      cout << ":";
-    }
+  getmonname(mon, dev, outp);
+  namesize = nmz->namelength(dev);
+  cout << nmz->namestr(dev);
+  if (outp != blankname) {
+    cout << "." << nmz->namestr(outp);
+    namesize = namesize + nmz->namelength(outp) + 1;
+  }
 
-    for (auto i : mon.sig) {
-      switch (i) {
-        case high:    cout << "-"; break;
-        case low:     cout << "_"; break;
-        case rising:  cout << "/"; break;
-        case falling: cout << "\\"; break;
-        case floating: cout << "?"; break;
-        case indet: cout << "~"; break;
-      }
-    }
-    cout << endl;
+  if ((margin - namesize) > 0) {
+    for (i = 0; i < (margin - namesize - 1); i++)
+      cout << " ";
+    cout << ":";
+  }
+}
+
+
+/** Returns the character a signal is displayed as in a trace
+ *
+ * @author Gee
+ */
+char monitor::tracechar (asignal s)
+{
+  switch (s) {
+    case high:     return '-';
+    case low:      return '_';
+    case rising:   return '/';
+    case falling:  return '\\';
+    case floating: return '?';
+    case indet:    return '~';
   }
+  return ' ';
 }
 
 
@@ -228,7 +359,7 @@ void monitor::displaysignals (void)
  */
 int monitor::findmonitor (name dev, name pin, bool inclAlias) {
   for (int n = 0; n < mtab.size(); n++) {
-    if (mtab[n].devid == dev && (!mtab[n].op || mtab[n].op->id == pin))
+    if (mtab[n].devid == dev && mtab[n].pinid == pin)
       return n;
 
     if (inclAlias
@@ -244,10 +375,14 @@ int monitor::findmonitor (name dev, name pin, bool inclAlias) {
  *
  * @author Gee
  */
-monitor::monitor (names* names_mod, network* network_mod)
+monitor::monitor (names* names_mod, network* network_mod, devices* devices_mod)
 {
   nmz = names_mod;
   netz = network_mod;
+  dmz = devices_mod;
+  capacity = maxcycles;
+  stats = NULL;
+  vcd = new vcdwriter(nmz, dmz, this);
   mtab.clear();
 }
 
@@ -257,4 +392,5 @@ monitor::monitor (names* names_mod, network* network_mod)
  * @author Diesel
  */
 monitor::~monitor() {
+  delete vcd;
 }
@@ -8,9 +8,11 @@
 #include "../com/sourcepos.h"
 #include "network.h"
 #include "devices.h"
+#include "tracebuffer.h"
+#include "vcdwriter.h"
 
 const int maxmonitors = 1000;      /* max number of monitor points */
-const int maxcycles = 100000;        /* max number of cycles per run */
+const int maxcycles = 100000;        /* default number of cycles of history kept */
 
 
 /** The data associated with a monitor
@@ -19,12 +21,13 @@ const int maxcycles = 100000;        /* max number of cycles per run */
  */
 struct moninfo {
   name devid;
+  name pinid;
   outplink op;
   SourcePos definedAt;
 
   name aliasDev;
   name aliasPin;
-  std::vector<asignal> sig;
+  tracebuffer sig;
 };
 typedef std::vector<moninfo> monitortable;
 
@@ -36,12 +39,18 @@ typedef std::vector<moninfo> monitortable;
 class monitor {
   names*   nmz;     // version of names class to use.
   network* netz;    // version of the network class to use.
+  devices* dmz;     // version of the devices class to use.
 
   monitortable mtab;                 // table of monitored signals
+  int capacity;                      // cycles of history kept for each monitor
+  vcdwriter* vcd;                    // value change dump of the monitors
+  simstats* stats;                   // counters updated while profiling, or NULL
 
   SourcePos& getdefinedpos(moninfo& m);
   asignal getmonsignal (const moninfo& mon) const;
   void getmonname (moninfo& mon, name& dev, name& outp, bool alias = true);
+  void displayname (moninfo& mon);
+  static char tracechar (asignal s);
 
  public:
 
@@ -121,15 +130,74 @@ class monitor {
    */
   void resetmonitor (void);
 
-  /** Records the state of all monitor points to the history
+  /** Records the state of all monitor points to the history. Once the
+   *  history is full, the oldest cycle is dropped.
+   *
+   * @param[in]  ncycles  The number of cycles to record the current state
+   *                      for, e.g. cycles skipped by devices::skipidle.
+   */
+  void recordsignals (int ncycles = 1);
+
+  /** Starts or stops timing recordsignals, see devices::profile.
+   *
+   * @param      st    The counters to add to, or NULL to stop profiling.
+   */
+  void profile (simstats* st);
+
+  /** Sets the number of cycles of history kept for each monitor, keeping
+   *  the most recent cycles already recorded.
+   *
+   * @param[in]  n     The number of cycles to keep, at least 1.
+   */
+  void setcapacity (int n);
+
+  /** Returns the number of cycles of history kept for each monitor.
+   *
+   * @return     The history capacity, maxcycles unless changed.
+   */
+  int getcapacity (void) const;
+
+  /** Copies the history of every monitor, e.g. for a checkpoint.
+   *
+   * @param      h     Returns the history of each monitor.
+   */
+  void gethistory (std::vector<tracebuffer>& h) const;
+
+  /** Replaces the history of every monitor with one copied by gethistory.
+   *  The VCD file, if any, carries on from where it was.
+   *
+   * @param[in]  h     The history of each monitor.
+   * @return     False if h doesn't have one entry for each monitor, in which
+   *             case nothing is changed.
+   */
+  bool sethistory (const std::vector<tracebuffer>& h);
+
+  /** Starts streaming the monitored signals to a VCD file as they are
+   *  recorded, see vcdwriter. The monitors present when the next cycle is
+   *  recorded are included in the dump.
+   *
+   * @param[in]  fname  The path of the file to write.
+   * @return     False if the file could not be opened.
+   */
+  bool startvcd (std::string fname);
+
+  /** Finishes and closes the VCD file, if one is being written.
    */
-  void recordsignals (void);
+  void stopvcd (void);
 
   /** Displays the state of monitored signals
    *  Used by the CLI.
    */
   void displaysignals (void);
 
+  /** Displays a trace of a monitored signal, as displaysignals, for traces
+   *  recorded elsewhere, e.g. by bitsim.
+   *
+   * @param[in]  m      The index of the monitor.
+   * @param[in]  trace  The signal on each cycle.
+   */
+  void displaytrace (int m, const std::vector<asignal>& trace);
+
   /** Gets the index of the monitor measuring the given signal
    *
    * @param[in]  dev        The name id of the device
@@ -145,8 +213,9 @@ class monitor {
    *
    * @param      names_mod    The name table instance to use
    * @param      network_mod  The network instance to use.
+   * @param      devices_mod  The devices instance, which holds the signal values.
    */
-  monitor (names* names_mod, network* network_mod);
+  monitor (names* names_mod, network* network_mod, devices* devices_mod);
 
   /** Clears resources allocated by monitor
    */
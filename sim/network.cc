@@ -1,4 +1,5 @@
 
+#include <algorithm>
 #include <iostream>
 #include "../com/sourcepos.h"
 #include "../com/errorhandler.h"
@@ -26,21 +27,8 @@ devlink network::devicelist (void)
  */
 devlink network::findoutputdevice(const outplink ol)
 {
-  devlink d = devs;
-  outplink o;
-
-  while (d != NULL) {
-    o = d->olist;
-
-    while (o != NULL) {
-      if (o == ol) return d;
-      o = o->next;
-    }
-
-    d = d->next;
-  }
-
-  return NULL;
+  auto it = outpowner.find(ol);
+  return (it == outpowner.end()) ? NULL : it->second;
 }
 
 
@@ -99,16 +87,7 @@ std::vector<outputsignal> network::findoutputsignals(){
  */
 devlink network::finddevice (name id)
 {
-  devlink d;
-  bool found;
-  found = false;
-  d = devs;
-  while ((d != NULL) && (! found)) {
-    found = (d->id == id);
-    if (! found)
-      d = d->next;
-  }
-  return d;
+  return (id < devindex.size ()) ? devindex[id] : NULL;
 }
 
 
@@ -118,16 +97,8 @@ devlink network::finddevice (name id)
  */
 inplink network::findinput (devlink dev, name id)
 {
-  inplink i;
-  bool found;
-  i = dev->ilist;
-  found = false;
-  while ((i != NULL) && (! found)) {
-    found = (i->id == id);
-    if (! found)
-        i = i->next;
-  }
-  return i;
+  auto it = inpindex.find (pinkey (dev, id));
+  return (it == inpindex.end ()) ? NULL : it->second;
 }
 
 
@@ -137,16 +108,8 @@ inplink network::findinput (devlink dev, name id)
  */
 outplink network::findoutput (devlink dev, name id)
 {
-  outplink o;
-  bool found;
-  o = dev->olist;
-  found = false;
-  while ((o != NULL) && (! found)) {
-    found = (o->id == id);
-    if (! found)
-        o = o->next;
-  }
-  return o;
+  auto it = outpindex.find (pinkey (dev, id));
+  return (it == outpindex.end ()) ? NULL : it->second;
 }
 
 
@@ -162,6 +125,16 @@ void network::adddevice (devicekind dkind, name did, devlink& dev, SourcePos at)
   dev->kind = dkind;
   dev->ilist = NULL;
   dev->olist = NULL;
+  dev->index = -1;
+  std::fill (dev->pin, dev->pin + 4, (inplink) NULL);
+  std::fill (dev->opin, dev->opin + 2, (outplink) NULL);
+  rev++;
+  // finddevice returns the first match in the list, so a device at the
+  // head replaces any of the same name in the index, one at the end doesn't
+  if (did >= devindex.size ())
+    devindex.resize (did + 1, NULL);
+  if ((dkind != aclock && dkind != siggen) || devindex[did] == NULL)
+    devindex[did] = dev;
   if (dkind != aclock && dkind != siggen) {        // device goes at head of list
     if (lastdev == NULL)
         lastdev = dev;
@@ -192,6 +165,8 @@ void network::addinput (devlink dev, name iid, SourcePos at)
   i->connect = NULL;
   i->next = dev->ilist;
   dev->ilist = i;
+  inpindex[pinkey (dev, iid)] = i;
+  rev++;
 }
 
 
@@ -204,9 +179,74 @@ void network::addoutput (devlink dev, name oid, SourcePos at)
   outplink o = new outputrec;
   o->id = oid;
   o->definedAt = at;
-  o->sig = low;
+  o->sigid = -1;
   o->next = dev->olist;
   dev->olist = o;
+  outpindex[pinkey (dev, oid)] = o;
+  outpowner[o] = dev;
+  rev++;
+}
+
+
+/** Moves an output to another device under a new pin name.
+ *
+ * @author Diesel
+ */
+void network::moveoutput (outplink o, devlink dev, name oid)
+{
+  devlink owner = findoutputdevice (o);
+  if (owner != NULL) {
+    outplink* p = &owner->olist;
+    while (*p != o)
+      p = &(*p)->next;
+    *p = o->next;
+    outpindex.erase (pinkey (owner, o->id));
+  }
+  o->id = oid;
+  o->next = dev->olist;
+  dev->olist = o;
+  outpindex[pinkey (dev, oid)] = o;
+  outpowner[o] = dev;
+  rev++;
+}
+
+
+/** Removes a device from the network and frees it.
+ *
+ * @author Diesel
+ */
+void network::removedevice (devlink dev)
+{
+  devlink* p = &devs;
+  devlink prev = NULL;
+  while (*p != dev) {
+    prev = *p;
+    p = &(*p)->next;
+  }
+  *p = dev->next;
+  if (lastdev == dev)
+    lastdev = prev;
+
+  if (finddevice (dev->id) == dev)
+    devindex[dev->id] = NULL;
+
+  while (dev->ilist != NULL) {
+    inplink i = dev->ilist;
+    dev->ilist = i->next;
+    inpindex.erase (pinkey (dev, i->id));
+    delete i;
+  }
+  while (dev->olist != NULL) {
+    outplink o = dev->olist;
+    dev->olist = o->next;
+    outpindex.erase (pinkey (dev, o->id));
+    outpowner.erase (o);
+    delete o;
+  }
+  if (dev->kind == imported)
+    delete dev->device;
+  delete dev;
+  rev++;
 }
 
 
@@ -226,8 +266,10 @@ void network::makeconnection (name idev, name inp, name odev, name outp, bool& o
     o = findoutput (dout, outp);
     i = findinput (din, inp);
     ok = ((o != NULL) && (i != NULL));
-    if (ok)
+    if (ok) {
       i->connect = o;
+      rev++;
+    }
   }
 }
 
@@ -278,6 +320,26 @@ void network::checknetwork (errorcollector& col)
 }
 
 
+/** Hashes a device and pin name
+ *
+ * @author Diesel
+ */
+size_t network::pinhash::operator() (const pinkey& k) const
+{
+  return std::hash<devlink> () (k.first) * 31 + namehash () (k.second);
+}
+
+
+/** Returns the revision counter of the network
+ *
+ * @author Diesel
+ */
+int network::revision () const
+{
+  return rev;
+}
+
+
 /** Initialises the network
  *
  * @author Gee
@@ -287,6 +349,7 @@ network::network (names* names_mod)
   nmz = names_mod;
   devs = NULL;
   lastdev = NULL;
+  rev = 0;
 }
 
 
@@ -2,6 +2,8 @@
 #define network_h
 
 #include <vector>
+#include <unordered_map>
+#include <utility>
 #include "../com/names.h"
 #include "../com/sourcepos.h"
 #include "../com/errorhandler.h"
@@ -31,7 +33,7 @@ struct outputsignal {
 struct outputrec {
   name       id;
   SourcePos  definedAt;
-  asignal    sig;
+  int        sigid;     // signal number in the compiled network, see simkernel
   outputrec* next;
 };
 typedef outputrec* outplink;
@@ -61,19 +63,26 @@ struct devicerec {
   outplink olist;
   devicerec* next;
   devicekind kind;
-  /* the next elements are only used by some of the device kinds */
-  asignal swstate;      // used when kind == aswitch
-  int frequency;        // used when kind == aclock
-  int counter;          // used when kind == aclock
-  asignal memory;       // used when kind == dtype
+  int index;            // device number in the compiled network, see simkernel
+  /* the next elements are only used by some of the device kinds, the state
+     of the devices as they are simulated is held in a devstate */
+  asignal swstate;      // initial setting, used when kind == aswitch
+  int frequency;        // used when kind == aclock or siggen
   importeddevice* device;  // used when kind == imported
-  int bitstrpos;           // used when kind == siggen
+  inplink pin[4];          // used when kind == dtype or aselect, see devices::resolvepins
+  outplink opin[2];        // used when kind == dtype
   std::vector<bool> bitstr; // used when kind == siggen
 
   SourcePos setAt;
 };
 typedef devicerec* devlink;
 
+/* Positions of the fixed pins of DTYPE and SELECT devices in devicerec::pin
+   and devicerec::opin */
+enum { dtdata, dtclk, dtset, dtclear };
+enum { selsw, selhigh, sellow };
+enum { dtq, dtqbar };
+
 
 /** Stores a list of devices and provides methods for manipulating it.
  *
@@ -160,6 +169,22 @@ class network {
    */
   void addoutput (devlink dev, name oid, SourcePos at = SourcePos());
 
+  /** Moves an output to another device under a new pin name. Inputs connected
+   *  to the output stay connected.
+   *
+   * @param[in]  o     The output to move
+   * @param[in]  dev   The device the output is moved to
+   * @param[in]  oid   The new output pin name id
+   */
+  void moveoutput (outplink o, devlink dev, name oid);
+
+  /** Removes a device from the network and frees it, along with its inputs
+   *  and outputs. Nothing may still be connected to its outputs.
+   *
+   * @param[in]  dev   The device to remove
+   */
+  void removedevice (devlink dev);
+
   /** Creates a connection to the input of one device, from the output of another.
    *
    * @param[in]  idev  The device name id whose input is to be connected
@@ -178,6 +203,13 @@ class network {
    */
   void checknetwork (errorcollector& col);
 
+  /** Returns a counter which is incremented whenever devices, pins or
+   *  connections are added, so cached derived data can be invalidated.
+   *
+   * @return     The current revision of the network.
+   */
+  int revision () const;
+
   /** Initialises the network
    *
    * @param      names_mod  The names table instance to use.
@@ -191,6 +223,19 @@ class network {
  private:
   devlink devs;          // the list of devices
   devlink lastdev;       // last device in list of devices
+  int rev;               // revision counter, see revision()
+
+  /** Key for the pin indexes, a device and pin name
+   */
+  typedef std::pair<devlink, name> pinkey;
+  struct pinhash {
+    size_t operator() (const pinkey& k) const;
+  };
+
+  std::vector<devlink> devindex;                          // devices by name id
+  std::unordered_map<pinkey, inplink, pinhash> inpindex;   // inputs by device and name
+  std::unordered_map<pinkey, outplink, pinhash> outpindex; // outputs by device and name
+  std::unordered_map<outplink, devlink> outpowner;         // device of each output
 
 };
 
@@ -0,0 +1,291 @@
+#include <algorithm>
+#include <queue>
+#include <functional>
+#include "simkernel.h"
+
+
+/** Returns the signal connected to input i, or the constant low signal if
+ *  there is no such pin or it is not connected.
+ */
+static int32_t pinsignal (inplink i, int32_t lowsig)
+{
+  if (i == NULL || i->connect == NULL || i->connect->sigid < 0)
+    return lowsig;
+  return i->connect->sigid;
+}
+
+
+/** Compiles a network into flat arrays.
+ *
+ * @author Diesel
+ */
+void simkernel::build (network* netz)
+{
+  devlink d;
+  inplink i;
+  outplink o;
+  int32_t n, s;
+
+  dev.clear ();
+  kind.clear ();
+  outbegin.clear ();
+  inbegin.clear ();
+  insig.clear ();
+  olddev.clear ();
+  oldsig.clear ();
+
+  // Number the devices and their outputs
+  for (d = netz->devicelist (); d != NULL; d = d->next) {
+    olddev.push_back (d->index);
+    d->index = dev.size ();
+    dev.push_back (d);
+    kind.push_back (d->kind);
+    outbegin.push_back (oldsig.size ());
+
+    if (d->kind == dtype) {
+      for (outplink p : {d->opin[dtq], d->opin[dtqbar]}) {
+        oldsig.push_back (p->sigid);
+        p->sigid = oldsig.size () - 1;
+      }
+    }
+    else {
+      for (o = d->olist; o != NULL; o = o->next) {
+        oldsig.push_back (o->sigid);
+        o->sigid = oldsig.size () - 1;
+      }
+    }
+  }
+  outbegin.push_back (oldsig.size ());
+  lowsig = oldsig.size ();
+  oldsig.push_back (-1);
+
+  // Inputs can now be resolved to signal numbers
+  for (d = netz->devicelist (); d != NULL; d = d->next) {
+    inbegin.push_back (insig.size ());
+    switch (d->kind) {
+      case dtype:
+        for (int k = dtdata; k <= dtclear; k++)
+          insig.push_back (pinsignal (d->pin[k], lowsig));
+        break;
+      case aselect:
+        for (int k = selsw; k <= sellow; k++)
+          insig.push_back (pinsignal (d->pin[k], lowsig));
+        break;
+      default:
+        for (i = d->ilist; i != NULL; i = i->next)
+          insig.push_back ((i->connect && i->connect->sigid >= 0) ? i->connect->sigid : lowsig);
+        break;
+    }
+  }
+  inbegin.push_back (insig.size ());
+
+  // Fanout of each signal, by counting sort on the signal number. Devices are
+  // visited in turn, so a repeated input can only be the last entry.
+  std::vector<int32_t> fill (sigcount () + 1, 0);
+  fobegin.assign (sigcount () + 1, 0);
+  fanout.clear ();
+  for (n = 0; n < devcount (); n++) {
+    for (int32_t k = inbegin[n]; k < inbegin[n + 1]; k++) {
+      if (fill[insig[k]] != n + 1) {
+        fill[insig[k]] = n + 1;
+        fobegin[insig[k] + 1]++;
+      }
+    }
+  }
+  for (s = 0; s < sigcount (); s++)
+    fobegin[s + 1] += fobegin[s];
+  fanout.resize (fobegin.back ());
+  std::vector<int32_t> pos (fobegin.begin (), fobegin.end () - 1);
+  std::fill (fill.begin (), fill.end (), 0);
+  for (n = 0; n < devcount (); n++) {
+    for (int32_t k = inbegin[n]; k < inbegin[n + 1]; k++) {
+      if (fill[insig[k]] != n + 1) {
+        fill[insig[k]] = n + 1;
+        fanout[pos[insig[k]]++] = n;
+      }
+    }
+  }
+
+  levelize ();
+  revision = netz->revision ();
+}
+
+
+/** Returns true if the outputs of a device of kind k only change on a clock
+ *  tick or by the user, rather than in response to its inputs.
+ */
+static bool issource (devicekind k)
+{
+  return k == dtype || k == aclock || k == aswitch || k == siggen;
+}
+
+
+/** Sorts the devices into levelized order, using Tarjan's strongly connected
+ *  components algorithm on the logic between the sources to find the loops.
+ *  The search is iterative, as deep designs would overflow the stack.
+ *
+ * @author Diesel
+ */
+void simkernel::levelize ()
+{
+  struct frame { int32_t v, s, f; };
+  int32_t n = devcount ();
+  int32_t count = 0, v, w;
+  std::vector<int32_t> index (n, -1), lowlink (n, 0), comp;
+  std::vector<bool> onstack (n, false);
+  std::vector<int32_t> stack;
+  std::vector<frame> calls;
+  std::vector<std::vector<int32_t> > sccs;
+
+  // a component of one device is only a loop if it reads its own output
+  auto feedsitself = [this] (int32_t u) {
+    for (int32_t s = outbegin[u]; s < outbegin[u + 1]; s++)
+      for (int32_t f = fobegin[s]; f < fobegin[s + 1]; f++)
+        if (fanout[f] == u)
+          return true;
+    return false;
+  };
+
+  order.clear ();
+  cyclic.assign (n, false);
+
+  for (int32_t root = 0; root < n; root++) {
+    if (index[root] >= 0 || issource (kind[root]))
+      continue;
+    calls.push_back ({root, outbegin[root], fobegin[outbegin[root]]});
+    index[root] = lowlink[root] = count++;
+    stack.push_back (root);
+    onstack[root] = true;
+
+    while (!calls.empty ()) {
+      frame& c = calls.back ();
+      v = c.v;
+      if (c.s < outbegin[v + 1] && c.f >= fobegin[c.s + 1]) {
+        // move on to the fanout of the next output
+        c.s++;
+        if (c.s < outbegin[v + 1])
+          c.f = fobegin[c.s];
+        continue;
+      }
+      if (c.s < outbegin[v + 1]) {
+        w = fanout[c.f++];
+        if (issource (kind[w]))
+          continue;
+        if (index[w] < 0) {
+          index[w] = lowlink[w] = count++;
+          stack.push_back (w);
+          onstack[w] = true;
+          calls.push_back ({w, outbegin[w], fobegin[outbegin[w]]});
+        }
+        else if (onstack[w] && index[w] < lowlink[v]) {
+          lowlink[v] = index[w];
+        }
+        continue;
+      }
+
+      // all successors of v are done
+      if (lowlink[v] == index[v]) {
+        comp.clear ();
+        do {
+          w = stack.back ();
+          stack.pop_back ();
+          onstack[w] = false;
+          comp.push_back (w);
+        } while (w != v);
+        std::sort (comp.begin (), comp.end ());
+        if (comp.size () > 1 || feedsitself (comp[0]))
+          for (int32_t u : comp)
+            cyclic[u] = true;
+        sccs.push_back (comp);
+      }
+      calls.pop_back ();
+      if (!calls.empty () && lowlink[v] < lowlink[calls.back ().v])
+        lowlink[calls.back ().v] = lowlink[v];
+    }
+  }
+
+  // Each loop is then taken as a whole, and sources on their own, and they
+  // are ordered so that each comes after the logic feeding it, choosing the
+  // earliest in device list order whenever there is a choice. A loop reads
+  // sources and other loops as they are, so it isn't kept after them, and
+  // those stay in the order the sweep engine takes them.
+  std::vector<int32_t> group (n, -1), first, indegree;
+  std::priority_queue<int32_t, std::vector<int32_t>, std::greater<int32_t> > ready;
+  for (auto& c : sccs) {
+    for (int32_t u : c)
+      group[u] = first.size ();
+    first.push_back (c[0]);
+  }
+  for (v = 0; v < n; v++) {
+    if (group[v] < 0) {
+      group[v] = first.size ();
+      first.push_back (v);
+    }
+  }
+
+  auto follows = [this, &group] (int32_t u, int32_t w) {
+    return group[u] != group[w] && !issource (kind[w])
+      && !((issource (kind[u]) || cyclic[u]) && cyclic[w]);
+  };
+  indegree.assign (first.size (), 0);
+  for (v = 0; v < n; v++)
+    for (int32_t g = outbegin[v]; g < outbegin[v + 1]; g++)
+      for (int32_t f = fobegin[g]; f < fobegin[g + 1]; f++)
+        if (follows (v, fanout[f]))
+          indegree[group[fanout[f]]]++;
+  for (unsigned int c = 0; c < first.size (); c++)
+    if (indegree[c] == 0)
+      ready.push (first[c]);
+
+  while (!ready.empty ()) {
+    int32_t c = group[ready.top ()];
+    ready.pop ();
+    int32_t begin = order.size ();
+    if (c < (int32_t) sccs.size ())
+      order.insert (order.end (), sccs[c].begin (), sccs[c].end ());
+    else
+      order.push_back (first[c]);
+    for (int32_t p = begin; p < (int32_t) order.size (); p++) {
+      v = order[p];
+      for (int32_t g = outbegin[v]; g < outbegin[v + 1]; g++)
+        for (int32_t f = fobegin[g]; f < fobegin[g + 1]; f++)
+          if (follows (v, fanout[f]) && --indegree[group[fanout[f]]] == 0)
+            ready.push (first[group[fanout[f]]]);
+    }
+  }
+
+  rank.assign (n, 0);
+  for (v = 0; v < n; v++)
+    rank[order[v]] = v;
+}
+
+
+/** Returns the number of devices.
+ *
+ * @author Diesel
+ */
+int simkernel::devcount () const
+{
+  return dev.size ();
+}
+
+
+/** Returns the number of signals.
+ *
+ * @author Diesel
+ */
+int simkernel::sigcount () const
+{
+  return oldsig.size ();
+}
+
+
+/** Initialises an empty kernel.
+ *
+ * @author Diesel
+ */
+simkernel::simkernel ()
+{
+  lowsig = -1;
+  revision = -1;
+}
@@ -0,0 +1,84 @@
+#ifndef GF2_SIMKERNEL_H
+#define GF2_SIMKERNEL_H
+
+#include <vector>
+#include <cstdint>
+
+#include "network.h"
+
+
+/** Compiled form of a network, used by the simulator.
+ *
+ * The linked device, input and output lists of a network are frozen into
+ * contiguous arrays, so evaluating a device does not need to chase pointers.
+ * Devices are numbered in device list order, and every device output is given
+ * a signal number, stored in its outputrec::sigid.
+ *
+ * Inputs are stored in device list order, except for devices whose inputs have
+ * fixed roles, which are stored as:
+ *   DTYPE:  DATA, CLK, SET, CLEAR
+ *   SELECT: SW, HIGH, LOW
+ * and outputs in list order, except for DTYPE which are stored as Q, QBAR.
+ * Optional inputs that are not connected read from lowsig.
+ *
+ * @author Diesel
+ */
+struct simkernel {
+  std::vector<devlink>    dev;       // device record of each device
+  std::vector<devicekind> kind;      // kind of each device
+  std::vector<int32_t>    inbegin;   // device i reads insig[inbegin[i]] to insig[inbegin[i+1]-1]
+  std::vector<int32_t>    insig;     // the signal connected to each input
+  std::vector<int32_t>    outbegin;  // device i drives signals outbegin[i] to outbegin[i+1]-1
+  std::vector<int32_t>    fobegin;   // signal s is read by fanout[fobegin[s]] to fanout[fobegin[s+1]-1]
+  std::vector<int32_t>    fanout;    // device numbers reading each signal
+  std::vector<int32_t>    order;     // devices in levelized order, see levelize
+  std::vector<int32_t>    rank;      // position of each device in order
+  std::vector<bool>       cyclic;    // device is in a loop, see levelize
+  std::vector<int32_t>    olddev;    // number of each device in the previous build, or -1
+  std::vector<int32_t>    oldsig;    // number of each signal in the previous build, or -1
+  int lowsig;                        // signal which is always low
+  int revision;                      // network revision that was compiled, or -1
+
+  /** Compiles a network. The kernel only describes the network, the values
+   *  of the signals are held by each simulation state, see devstate. The
+   *  numbers devices and signals had in any previous compilation of the same
+   *  network are kept in olddev and oldsig, so states can be carried over.
+   *  The pins of DTYPE and SELECT devices must have been resolved, see
+   *  devices::resolvepins.
+   *
+   * @param      netz  The network to compile.
+   */
+  void build (network* netz);
+
+  /** Sorts the devices into levelized order, so an acyclic region can be
+   *  evaluated in one ordered pass. DTYPE, CLOCK, SWITCH and SIGGEN devices
+   *  are sources, and every other device comes after the logic feeding it.
+   *
+   *  Devices that feed back to themselves form strongly connected
+   *  components, which are marked in cyclic and kept together in device
+   *  list order. A loop reads its inputs as they are, as with the sweep
+   *  engine, so sources and loops are not sorted among themselves and keep
+   *  device list order, and only the logic between them is levelized.
+   *  Called by build.
+   */
+  void levelize ();
+
+  /** Returns the number of devices.
+   *
+   * @return     The number of devices in the compiled network.
+   */
+  int devcount () const;
+
+  /** Returns the number of signals, including lowsig.
+   *
+   * @return     The number of signals in the compiled network.
+   */
+  int sigcount () const;
+
+  /** Initialises an empty kernel, which needs to be built.
+   */
+  simkernel ();
+};
+
+
+#endif /* GF2_SIMKERNEL_H */
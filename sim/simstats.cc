@@ -0,0 +1,109 @@
+#include <iomanip>
+#include <algorithm>
+#include <cmath>
+
+#include "../com/localestrings.h"
+#include "../com/formatstring.h"
+
+#include "simstats.h"
+
+
+// device kinds as written in definition files
+static const char* const kindnames[baddevice] = {
+  "SWITCH", "CLOCK", "AND", "NAND", "OR", "NOR", "XOR", "DTYPE", "JK",
+  "SIGGEN", "SELECT", "imported"
+};
+
+
+/** Rounds to one decimal place, for printing.
+ */
+static double tenths (double x)
+{
+  return std::round (x * 10) / 10;
+}
+
+
+/** Adds a cycle to the histogram of machine cycles needed to settle.
+ *
+ * @author Diesel
+ */
+void simstats::addcycle (int machinecycles, bool settled)
+{
+  cycles++;
+  if (!settled) {
+    unsettled++;
+    return;
+  }
+  if ((int) settle.size () <= machinecycles)
+    settle.resize (machinecycles + 1, 0);
+  settle[machinecycles]++;
+}
+
+
+/** Prints a summary of the counters.
+ *
+ * @author Diesel
+ */
+void simstats::print (std::ostream& os, int limit) const
+{
+  const int barwidth = 40;
+  double per = (cycles > 0) ? 1.0 / cycles : 0;
+  int k;
+
+  os << formatString (t("Profile of {0} cycles, and {1} idle cycles skipped"), cycles, skipped) << std::endl;
+  os << t("Devices executed") << ":" << std::endl;
+  for (k = 0; k < baddevice; k++) {
+    if (evals[k] > 0)
+      os << "  " << std::left << std::setw (10) << kindnames[k] << std::right << std::setw (14) << evals[k]
+         << "  " << formatString (t("{0} per cycle"), tenths (evals[k] * per)) << std::endl;
+  }
+
+  os << formatString (t("Machine cycles to settle, limit {0}"), limit) << ":" << std::endl;
+  long long most = unsettled;
+  for (long long n : settle)
+    most = std::max (most, n);
+  for (k = 1; k < (int) settle.size (); k++) {
+    if (settle[k] > 0)
+      os << "  " << std::setw (8) << k << std::setw (14) << settle[k] << "  "
+         << std::string ((size_t) ((settle[k] * barwidth + most - 1) / most), '#') << std::endl;
+  }
+  if (unsettled > 0)
+    os << "  " << std::setw (8) << t("unsettled") << std::setw (14) << unsettled << "  "
+       << std::string ((size_t) ((unsettled * barwidth + most - 1) / most), '#') << std::endl;
+
+  os << formatString (t("Signal changes: {0}, {1} per cycle, at most {2} in one cycle"),
+                      changes, tenths (changes * per), maxchanges) << std::endl;
+  os << formatString (t("Time: clocks {0} ms, devices {1} ms, monitors {2} ms for {3} cycles recorded"),
+                      tenths (clocktime * 1e3), tenths (devicetime * 1e3), tenths (recordtime * 1e3),
+                      recorded) << std::endl;
+}
+
+
+/** Sets every counter to zero.
+ *
+ * @author Diesel
+ */
+void simstats::clear ()
+{
+  std::fill (evals, evals + baddevice, 0);
+  settle.clear ();
+  unsettled = 0;
+  cycles = 0;
+  skipped = 0;
+  changes = 0;
+  maxchanges = 0;
+  recorded = 0;
+  clocktime = 0;
+  devicetime = 0;
+  recordtime = 0;
+}
+
+
+/** Initialises the counters to zero
+ *
+ * @author Diesel
+ */
+simstats::simstats ()
+{
+  clear ();
+}
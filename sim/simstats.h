@@ -0,0 +1,57 @@
+#ifndef GF2_SIMSTATS_H
+#define GF2_SIMSTATS_H
+
+#include <vector>
+#include <iostream>
+
+#include "network.h"
+
+
+/** Counters collected while profiling a simulation, see devices::profile and
+ *  monitor::profile. Nothing is counted unless profiling is on, and then
+ *  only a counter is incremented for each device executed and signal
+ *  changed, and the clock read three times a cycle.
+ *
+ *  Devices inside imported devices are not counted separately, each run of
+ *  an imported device counts as one execution of it.
+ *
+ * @author Diesel
+ */
+struct simstats {
+  long long evals[baddevice];         // devices executed, by kind
+  std::vector<long long> settle;      // cycles by the machine cycles they took to settle
+  long long unsettled;                // cycles which did not settle
+  long long cycles;                   // cycles executed
+  long long skipped;                  // idle cycles skipped, see devices::skipidle
+  long long changes;                  // signal changes, including rising to high
+  long long maxchanges;               // most signal changes in one cycle
+  long long recorded;                 // cycles recorded by monitors
+  double clocktime;                   // seconds updating clocks
+  double devicetime;                  // seconds executing devices
+  double recordtime;                  // seconds recording monitors
+
+  /** Adds a cycle to the histogram of machine cycles needed to settle.
+   *
+   * @param[in]  machinecycles  The machine cycles run.
+   * @param[in]  settled        False if the cycle did not settle.
+   */
+  void addcycle (int machinecycles, bool settled);
+
+  /** Prints a summary of the counters.
+   *
+   * @param      os     The stream to print to.
+   * @param[in]  limit  The machine cycles allowed for a cycle to settle.
+   */
+  void print (std::ostream& os, int limit) const;
+
+  /** Sets every counter to zero.
+   */
+  void clear ();
+
+  /** Initialises the counters to zero
+   */
+  simstats ();
+};
+
+
+#endif /* GF2_SIMSTATS_H */
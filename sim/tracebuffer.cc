@@ -0,0 +1,197 @@
+#include "tracebuffer.h"
+
+
+/** Run length encodes a full block, if that makes it smaller.
+ *
+ * @author Diesel
+ */
+void tracebuffer::seal (traceblock& b)
+{
+  std::vector<uint8_t> runs;
+  uint8_t prev = b.data[0] & 0x0f, s;
+  for (int i = 1; i < blocksize; i++) {
+    s = (b.data[i >> 1] >> ((i & 1) * 4)) & 0x0f;
+    if (s != prev) {
+      runs.push_back (i - 1);
+      runs.push_back (prev);
+      prev = s;
+      if (runs.size () >= b.data.size ())
+        return;   // packed is smaller
+    }
+  }
+  runs.push_back (blocksize - 1);
+  runs.push_back (prev);
+  if (runs.size () < b.data.size ()) {
+    runs.shrink_to_fit ();
+    b.data.swap (runs);
+    b.rle = true;
+  }
+}
+
+
+/** Records a new cycle, dropping the oldest if the buffer is full.
+ *
+ * @author Diesel
+ */
+void tracebuffer::push (asignal s)
+{
+  int fill = (first + count) % blocksize;   // samples in the last block
+  if (fill == 0) {
+    blocks.push_back (traceblock ());
+    blocks.back ().data.reserve (blocksize / 2);
+    blocks.back ().rle = false;
+  }
+
+  traceblock& b = blocks.back ();
+  if (fill & 1)
+    b.data.back () |= s << 4;
+  else
+    b.data.push_back (s);
+  if (fill == blocksize - 1)
+    seal (b);
+
+  if (count < capacity) {
+    count++;
+  } else if (++first == blocksize) {
+    blocks.pop_front ();
+    first = 0;
+  }
+}
+
+
+/** Records a number of cycles with the same level.
+ *
+ * @author Diesel
+ */
+void tracebuffer::push (asignal s, int n)
+{
+  if (n >= capacity) {
+    clear ();
+    n = capacity;
+  }
+  while (n > 0) {
+    if ((first + count) % blocksize == 0 && n >= blocksize) {
+      blocks.push_back (traceblock ());
+      blocks.back ().data = {blocksize - 1, (uint8_t) s};
+      blocks.back ().rle = true;
+      count += blocksize;
+      n -= blocksize;
+      trim ();
+    }
+    else {
+      push (s);
+      n--;
+    }
+  }
+}
+
+
+/** Drops the oldest cycles while more than capacity are held.
+ *
+ * @author Diesel
+ */
+void tracebuffer::trim ()
+{
+  if (count > capacity) {
+    first += count - capacity;
+    count = capacity;
+    while (first >= blocksize) {
+      blocks.pop_front ();
+      first -= blocksize;
+    }
+  }
+}
+
+
+/** Returns the signal level in a cycle.
+ *
+ * @author Diesel
+ */
+asignal tracebuffer::get (int c) const
+{
+  int p = first + c;
+  const traceblock& b = blocks[p / blocksize];
+  int i = p % blocksize;
+
+  if (!b.rle)
+    return (asignal) ((b.data[i >> 1] >> ((i & 1) * 4)) & 0x0f);
+
+  // binary search for the first run ending at or after i
+  int lo = 0, hi = b.data.size () / 2 - 1;
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    if (b.data[mid * 2] < i)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return (asignal) b.data[lo * 2 + 1];
+}
+
+
+/** Returns the number of cycles held.
+ *
+ * @author Diesel
+ */
+int tracebuffer::size () const
+{
+  return count;
+}
+
+
+/** Removes all cycles from the buffer.
+ *
+ * @author Diesel
+ */
+void tracebuffer::clear ()
+{
+  blocks.clear ();
+  first = 0;
+  count = 0;
+}
+
+
+/** Changes the capacity, dropping the oldest cycles if more are held.
+ *
+ * @author Diesel
+ */
+void tracebuffer::setcapacity (int n)
+{
+  capacity = (n < 1) ? 1 : n;
+  trim ();
+}
+
+
+/** Returns the capacity.
+ *
+ * @author Diesel
+ */
+int tracebuffer::getcapacity () const
+{
+  return capacity;
+}
+
+
+/** Returns the memory used to hold the samples.
+ *
+ * @author Diesel
+ */
+size_t tracebuffer::memoryused () const
+{
+  size_t n = 0;
+  for (const traceblock& b : blocks)
+    n += sizeof (traceblock) + b.data.capacity ();
+  return n;
+}
+
+
+/** Initialises an empty buffer
+ *
+ * @author Diesel
+ */
+tracebuffer::tracebuffer (int n)
+{
+  first = 0;
+  count = 0;
+  capacity = (n < 1) ? 1 : n;
+}
@@ -0,0 +1,103 @@
+#ifndef GF2_TRACEBUFFER_H
+#define GF2_TRACEBUFFER_H
+
+#include <vector>
+#include <deque>
+#include <cstdint>
+
+#include "network.h"
+
+
+/** Fixed capacity history of a signal, used by monitor.
+ *
+ *  Cycles are held in blocks of blocksize samples. The block being filled
+ *  is packed at 4 bits per sample. Once full, a block is run length encoded
+ *  instead if that is smaller, which is the case for most signals apart from
+ *  fast clocks. Each block starts at a known cycle, so reading a cycle only
+ *  decodes within one block.
+ *
+ *  Once capacity cycles are held, each new cycle drops the oldest, and
+ *  blocks are freed as they empty. Cycles are indexed from the oldest still
+ *  held, which is cycle 0.
+ *
+ * @author Diesel
+ */
+class tracebuffer {
+  friend class checkpoint;
+  static const int blocksize = 256;
+
+  /** A block of samples, either packed two to a byte, or as runs stored as
+   *  pairs of (last sample of run, signal).
+   */
+  struct traceblock {
+    std::vector<uint8_t> data;
+    bool rle;
+  };
+
+  std::deque<traceblock> blocks;
+  int first;        // sample in blocks[0] which is cycle 0
+  int count;        // number of cycles held
+  int capacity;     // maximum number of cycles held
+
+  void seal (traceblock& b);
+  void trim ();
+
+ public:
+  /** Records a new cycle, dropping the oldest if the buffer is full.
+   *
+   * @param[in]  s     The signal level in the new cycle.
+   */
+  void push (asignal s);
+
+  /** Records a number of cycles with the same level, dropping the oldest
+   *  as push does. Whole blocks are added already run length encoded.
+   *
+   * @param[in]  s     The signal level in the new cycles.
+   * @param[in]  n     The number of cycles.
+   */
+  void push (asignal s, int n);
+
+  /** Returns the signal level in a cycle.
+   *
+   * @param[in]  c     The cycle, from 0 to size()-1.
+   * @return     The signal level recorded in cycle c.
+   */
+  asignal get (int c) const;
+
+  /** Returns the number of cycles held.
+   *
+   * @return     The number of cycles in the buffer.
+   */
+  int size () const;
+
+  /** Removes all cycles from the buffer.
+   */
+  void clear ();
+
+  /** Changes the capacity, dropping the oldest cycles if more are held.
+   *
+   * @param[in]  n     The maximum number of cycles to hold, at least 1.
+   */
+  void setcapacity (int n);
+
+  /** Returns the capacity.
+   *
+   * @return     The maximum number of cycles held.
+   */
+  int getcapacity () const;
+
+  /** Returns the memory used to hold the samples.
+   *
+   * @return     The approximate size of the history in bytes.
+   */
+  size_t memoryused () const;
+
+  /** Initialises an empty buffer
+   *
+   * @param[in]  n     The maximum number of cycles to hold.
+   */
+  tracebuffer (int n = 1);
+};
+
+
+#endif /* GF2_TRACEBUFFER_H */
@@ -0,0 +1,141 @@
+/* Unit tests for the monitor trace buffer.
+ * Each buffer is checked cycle by cycle against a plain deque holding the
+ * same history, through wraparound at capacity, runs across the boundaries
+ * of blocks and changes of capacity.
+ *
+ * Tests require the google test framework
+ * https://github.com/google/googletest
+ *
+ * @author     Diesel
+ */
+
+
+#include "tracebuffer.h"
+#include "gtest/gtest.h"
+
+#include <deque>
+
+
+static const int blocksize = 256;
+static const asignal levels[] = {falling, low, rising, high, floating, indet};
+
+
+// Trace buffer test controller, keeping the history expected alongside
+// @author   Diesel
+class TraceBufferTest : public ::testing::Test {
+    protected:
+
+    tracebuffer buf;
+    std::deque<asignal> expected;
+    int capacity;
+
+    void setcapacity(int n) {
+        capacity = n;
+        buf.setcapacity(n);
+        while ((int) expected.size() > capacity)
+            expected.pop_front();
+    }
+
+    void push(asignal s, int n = 1) {
+        if (n == 1)
+            buf.push(s);
+        else
+            buf.push(s, n);
+        for (int i = 0; i < n; i++) {
+            expected.push_back(s);
+            if ((int) expected.size() > capacity)
+                expected.pop_front();
+        }
+    }
+
+    // Pushes cycles which change every few cycles, through every level
+    void pushmixed(int n) {
+        for (int i = 0; i < n; i++)
+            push(levels[(i / 3 + i / 7) % 6]);
+    }
+
+    void testcontents() {
+        ASSERT_EQ((int) expected.size(), buf.size());
+        for (int c = 0; c < buf.size(); c++)
+            ASSERT_EQ(expected[c], buf.get(c)) << "cycle " << c;
+    }
+};
+
+
+// @author   Diesel
+TEST_F(TraceBufferTest, WrapsAtCapacity){
+    setcapacity(1000);
+    pushmixed(999);
+    testcontents();
+    pushmixed(2);
+    testcontents();
+    for (int i = 0; i < 5; i++) {
+        pushmixed(777);
+        testcontents();
+    }
+    EXPECT_EQ(1000, buf.size());
+    EXPECT_EQ(1000, buf.getcapacity());
+
+    // whole blocks of runs added to a full buffer
+    for (int i = 0; i < 5; i++) {
+        push(low, 600);
+        testcontents();
+        push(high, 3 * blocksize + i);
+        testcontents();
+    }
+}
+
+// Runs added a cycle at a time and all at once, ending in a later block
+// @author   Diesel
+TEST_F(TraceBufferTest, RunAcrossBlockBoundary){
+    setcapacity(10000);
+    pushmixed(blocksize - 10);
+    for (int i = 0; i < 20; i++)
+        push(high);
+    testcontents();
+    pushmixed(blocksize - 30);
+    push(low, 20);
+    push(indet);
+    testcontents();
+}
+
+// @author   Diesel
+TEST_F(TraceBufferTest, RunLongerThanBlock){
+    setcapacity(10000);
+    push(low, 3 * blocksize);
+    testcontents();
+    pushmixed(5);
+    push(high, 2 * blocksize + 17);
+    pushmixed(blocksize - 22);
+    push(floating, 5 * blocksize);
+    testcontents();
+
+    // a run longer than the capacity leaves only the run
+    setcapacity(700);
+    push(rising, 2000);
+    testcontents();
+    push(falling, 3);
+    testcontents();
+}
+
+// Shrinking keeps the latest cycles, and the buffer fills on from there
+// @author   Diesel
+TEST_F(TraceBufferTest, ShrinkBelowSize){
+    setcapacity(2000);
+    pushmixed(1500);
+    setcapacity(300);
+    EXPECT_EQ(300, buf.size());
+    testcontents();
+    pushmixed(400);
+    testcontents();
+
+    setcapacity(1);
+    testcontents();
+    push(high);
+    testcontents();
+
+    setcapacity(1000);
+    push(low, 600);
+    pushmixed(100);
+    testcontents();
+}
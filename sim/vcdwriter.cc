@@ -0,0 +1,166 @@
+#include "devices.h"
+#include "monitor.h"
+#include "vcdwriter.h"
+
+using namespace std;
+
+
+/** Opens a file and starts a new dump.
+ *
+ * @author Diesel
+ */
+bool vcdwriter::open (std::string fname)
+{
+  close ();
+  out.open (fname.c_str (), ios::out | ios::trunc);
+  started = false;
+  dumpall = true;
+  time = 0;
+  vars.clear ();
+  return out.is_open ();
+}
+
+
+/** Finishes the dump and closes the file.
+ *
+ * @author Diesel
+ */
+void vcdwriter::close (void)
+{
+  if (out.is_open ()) {
+    if (started)
+      out << "#" << time << endl;
+    out.close ();
+  }
+}
+
+
+/** Returns true if a dump is being written.
+ *
+ * @author Diesel
+ */
+bool vcdwriter::isopen (void) const
+{
+  return out.is_open ();
+}
+
+
+/** Writes the header, declaring a variable for each monitor.
+ *
+ * @author Diesel
+ */
+void vcdwriter::writeheader (void)
+{
+  name dev, outp;
+
+  out << "$version GF2 logic simulator $end" << endl;
+  out << "$timescale 1 ns $end" << endl;
+  out << "$scope module circuit $end" << endl;
+  for (int n = 0; n < mmz->moncount (); n++) {
+    vcdvar v;
+    // identifier codes are printable characters, counting in base 94
+    int k = n;
+    do {
+      v.id += (char) ('!' + k % 94);
+      k = k / 94;
+    } while (k > 0);
+    v.op = mmz->getoutplink (n);
+    v.last = ' ';
+    vars.push_back (v);
+
+    mmz->getmonname (n, dev, outp);
+    out << "$var wire 1 " << v.id << " " << nmz->namestr (dev);
+    if (outp != blankname)
+      out << "." << nmz->namestr (outp);
+    out << " $end" << endl;
+  }
+  out << "$upscope $end" << endl;
+  out << "$enddefinitions $end" << endl;
+  started = true;
+}
+
+
+/** Writes the changes in the monitored signals for new cycles. Nothing is
+ *  written for the cycles after the first, as nothing changes.
+ *
+ * @author Diesel
+ */
+void vcdwriter::record (int ncycles)
+{
+  if (!out.is_open ())
+    return;
+  if (!started)
+    writeheader ();
+
+  bool stamped = false;
+  for (auto& v : vars) {
+    char c = v.op ? vcdvalue (dmz->getsignal (v.op)) : 'z';
+    if (c != v.last || dumpall) {
+      if (!stamped) {
+        out << "#" << time << "\n";
+        if (dumpall)
+          out << (time == 0 ? "$dumpvars\n" : "$comment new run $end\n");
+        stamped = true;
+      }
+      out << c << v.id << "\n";
+      v.last = c;
+    }
+  }
+  if (stamped && dumpall && time == 0)
+    out << "$end\n";
+  dumpall = false;
+  time += ncycles;
+}
+
+
+/** Marks the start of a new run.
+ *
+ * @author Diesel
+ */
+void vcdwriter::restart (void)
+{
+  dumpall = true;
+}
+
+
+/** Returns the VCD value character for a signal.
+ *
+ * @author Diesel
+ */
+char vcdwriter::vcdvalue (asignal s)
+{
+  switch (s) {
+    case high:
+    case rising:   return '1';
+    case low:
+    case falling:  return '0';
+    case floating: return 'z';
+    case indet:
+    default:       return 'x';
+  }
+}
+
+
+/** Initialises the writer, with no file open.
+ *
+ * @author Diesel
+ */
+vcdwriter::vcdwriter (names* names_mod, devices* devices_mod, monitor* monitor_mod)
+{
+  nmz = names_mod;
+  dmz = devices_mod;
+  mmz = monitor_mod;
+  started = false;
+  dumpall = true;
+  time = 0;
+}
+
+
+/** Closes the dump, if one is open.
+ *
+ * @author Diesel
+ */
+vcdwriter::~vcdwriter ()
+{
+  close ();
+}
@@ -0,0 +1,101 @@
+#ifndef GF2_VCDWRITER_H
+#define GF2_VCDWRITER_H
+
+#include <string>
+#include <vector>
+#include <fstream>
+
+#include "../com/names.h"
+#include "network.h"
+
+class devices;
+class monitor;
+
+
+/** Streams monitored signals to a Value Change Dump file, for viewing in
+ *  external waveform viewers.
+ *
+ *  The header is written when the first cycle is recorded, declaring one
+ *  variable for each monitor present at that point, named by its alias if it
+ *  has one. After that only the values that changed are written for each
+ *  cycle, so nothing is held in memory. One cycle is one unit of time, and
+ *  time keeps counting across runs of the simulation.
+ *
+ *  rising and high are written as 1, falling and low as 0, floating as z
+ *  and indet as x.
+ *
+ * @author Diesel
+ */
+class vcdwriter {
+  names*   nmz;
+  devices* dmz;
+  monitor* mmz;
+
+  /** A variable in the dump
+   */
+  struct vcdvar {
+    outplink op;       // signal being dumped
+    std::string id;    // identifier code in the file
+    char last;         // last value written
+  };
+
+  std::ofstream out;
+  std::vector<vcdvar> vars;
+  bool started;        // the header has been written
+  bool dumpall;        // write every value in the next cycle
+  long long time;      // cycles recorded
+
+  void writeheader (void);
+
+ public:
+  /** Opens a file and starts a new dump, closing any previous one.
+   *
+   * @param[in]  fname  The path of the file to write.
+   * @return     False if the file could not be opened.
+   */
+  bool open (std::string fname);
+
+  /** Finishes the dump and closes the file.
+   */
+  void close (void);
+
+  /** Returns true if a dump is being written.
+   *
+   * @return     True if a file is open.
+   */
+  bool isopen (void) const;
+
+  /** Writes the changes in the monitored signals for new cycles.
+   *  Called by monitor::recordsignals.
+   *
+   * @param[in]  ncycles  The number of cycles the signals are held for.
+   */
+  void record (int ncycles = 1);
+
+  /** Marks the start of a new run, so every value is written again in the
+   *  next cycle. Called by monitor::resetmonitor.
+   */
+  void restart (void);
+
+  /** Returns the VCD value character for a signal.
+   *
+   * @param[in]  s     The signal level.
+   * @return     '0', '1', 'z' or 'x'.
+   */
+  static char vcdvalue (asignal s);
+
+  /** Initialises the writer, with no file open.
+   *
+   * @param      names_mod    The names table instance to use.
+   * @param      devices_mod  The devices instance, which holds the signal values.
+   * @param      monitor_mod  The monitor instance, whose monitor points are dumped.
+   */
+  vcdwriter (names* names_mod, devices* devices_mod, monitor* monitor_mod);
+
+  /** Closes the dump, if one is open.
+   */
+  ~vcdwriter ();
+};
+
+
+#endif /* GF2_VCDWRITER_H */
@@ -0,0 +1,186 @@
+/* Unit tests for the value change dump writer.
+ * Small networks are simulated with a dump open, and the file written is
+ * compared with the text expected.
+ *
+ * Tests require the google test framework
+ * https://github.com/google/googletest
+ *
+ * @author     Diesel
+ */
+
+
+#include "vcdwriter.h"
+#include "gtest/gtest.h"
+
+#include <string>
+#include <sstream>
+#include <fstream>
+#include <cstdio>
+
+#include "../com/names.h"
+#include "../sim/network.h"
+#include "../sim/devices.h"
+#include "../sim/monitor.h"
+#include "../lang/scanner.h"
+#include "../lang/parser.h"
+
+
+// VCD writer test controller
+// @author   Diesel
+class VcdWriterTest : public ::testing::Test {
+    protected:
+
+    names* nmz;
+    network* netz;
+    devices* dmz;
+    monitor* mmz;
+    std::string fname;
+
+    virtual void SetUp() {
+        nmz = new names();
+        netz = new network(nmz);
+        dmz = new devices(nmz, netz);
+        mmz = new monitor(nmz, netz, dmz);
+        fname = ::testing::TempDir() + "vcdwriter_unittest.vcd";
+    }
+
+    virtual void TearDown() {
+        delete mmz;
+        delete dmz;
+        delete netz;
+        delete nmz;
+        std::remove(fname.c_str());
+    }
+
+    void readdefinition(std::string def) {
+        strscanner smz(nmz, def);
+        parser pmz(netz, dmz, mmz, &smz, nmz);
+        ASSERT_TRUE(pmz.readin());
+        dmz->resetdevices();
+        mmz->resetmonitor();
+    }
+
+    void run(int ncycles) {
+        bool ok;
+        for (int c = 0; c < ncycles; c++) {
+            dmz->executedevices(ok);
+            ASSERT_TRUE(ok);
+            mmz->recordsignals();
+        }
+    }
+
+    // Returns the contents of the dump, once closed
+    std::string dumped() {
+        std::ifstream in(fname.c_str());
+        std::ostringstream ss;
+        ss << in.rdbuf();
+        return ss.str();
+    }
+};
+
+
+static const char* const header =
+    "$version GF2 logic simulator $end\n"
+    "$timescale 1 ns $end\n"
+    "$scope module circuit $end\n";
+
+static const char* const gates =
+    "dev SW = SWITCH { Initialvalue : 1; }\n"
+    "dev CLK = CLOCK { Period : 1; }\n"
+    "dev G = NAND { I1 : SW; I2 : CLK; }\n"
+    "monitor CLK, SW as S, G;\n";
+
+
+// Variables are named by alias, and every value is dumped at time 0, then
+// only changes
+// @author   Diesel
+TEST_F(VcdWriterTest, HeaderAndDumpvars){
+    readdefinition(gates);
+    ASSERT_TRUE(mmz->startvcd(fname));
+    run(3);
+    mmz->stopvcd();
+
+    EXPECT_EQ(std::string(header) +
+        "$var wire 1 ! CLK $end\n"
+        "$var wire 1 \" S $end\n"
+        "$var wire 1 # G $end\n"
+        "$upscope $end\n"
+        "$enddefinitions $end\n"
+        "#0\n"
+        "$dumpvars\n"
+        "0!\n"
+        "1\"\n"
+        "1#\n"
+        "$end\n"
+        "#1\n"
+        "1!\n"
+        "0#\n"
+        "#2\n"
+        "0!\n"
+        "1#\n"
+        "#3\n", dumped());
+}
+
+// A reset starts a new run, marked with a comment, and dumps every value
+// again without restarting time
+// @author   Diesel
+TEST_F(VcdWriterTest, NewRunMarker){
+    readdefinition(gates);
+    ASSERT_TRUE(mmz->startvcd(fname));
+    run(2);
+    dmz->resetdevices();
+    mmz->resetmonitor();
+    run(2);
+    mmz->stopvcd();
+
+    std::string vcd = dumped();
+    size_t body = vcd.find("$enddefinitions $end\n");
+    ASSERT_NE(std::string::npos, body);
+    EXPECT_EQ(
+        "$enddefinitions $end\n"
+        "#0\n"
+        "$dumpvars\n"
+        "0!\n"
+        "1\"\n"
+        "1#\n"
+        "$end\n"
+        "#1\n"
+        "1!\n"
+        "0#\n"
+        "#2\n"
+        "$comment new run $end\n"
+        "0!\n"
+        "1\"\n"
+        "1#\n"
+        "#3\n"
+        "1!\n"
+        "0#\n"
+        "#4\n", vcd.substr(body));
+}
+
+// Past 94 signals, identifiers take a second base 94 digit, low digit first
+// @author   Diesel
+TEST_F(VcdWriterTest, LongIdentifiers){
+    const int n = 200;
+    std::string def, mon = "monitor ";
+    for (int i = 0; i < n; i++) {
+        std::string sw = "SW" + std::to_string(i);
+        def += "dev " + sw + " = SWITCH { Initialvalue : " + std::to_string(i % 2) + "; }\n";
+        mon += sw + (i + 1 < n ? ", " : ";\n");
+    }
+    readdefinition(def + mon);
+    ASSERT_TRUE(mmz->startvcd(fname));
+    run(1);
+    mmz->stopvcd();
+
+    std::string vcd = dumped();
+    EXPECT_NE(std::string::npos, vcd.find("$var wire 1 ! SW0 $end\n"));
+    EXPECT_NE(std::string::npos, vcd.find("$var wire 1 ~ SW93 $end\n"));
+    EXPECT_NE(std::string::npos, vcd.find("$var wire 1 !\" SW94 $end\n"));
+    EXPECT_NE(std::string::npos, vcd.find("$var wire 1 \"\" SW95 $end\n"));
+    EXPECT_NE(std::string::npos, vcd.find("$var wire 1 ~\" SW187 $end\n"));
+    EXPECT_NE(std::string::npos, vcd.find("$var wire 1 !# SW188 $end\n"));
+    EXPECT_NE(std::string::npos, vcd.find("\n0!\n1\"\n"));
+    EXPECT_NE(std::string::npos, vcd.find("\n0!\"\n1\"\"\n"));
+    EXPECT_NE(std::string::npos, vcd.find("\n0!#\n1\"#\n"));
+}